@@ -2,42 +2,53 @@
  * Example of loading and rendering an .obj model.
  * Accepts the following command line args:
  * -w  Render as a wireframe
+ * -l  Render the simplest level of detail that looks the same at the frame's size
+ * -q  Render from a compressed copy of the model with quantized vertices
  */
 
 #include <cstring>
 #include <iostream>
+#include <optional>
 #include <random>
 
+#include "rastrum/Bvh.h"
+#include "rastrum/CompressedModel.h"
 #include "rastrum/FrameBuffer.h"
-#include "rastrum/Obj.h"
+#include "rastrum/Lod.h"
+#include "rastrum/Meshlet.h"
+#include "rastrum/ModelCache.h"
+#include "rastrum/Renderer.h"
+#include "rastrum/VertexCache.h"
 
 using namespace rastrum;
 
 constexpr size_t kBufferWidth = 2048;
 constexpr size_t kBufferHeight = 2048;
+constexpr auto kModelFile = "../data/centurion_helmet/centurion_helmet.obj";
 constexpr auto kOutputFile = "image.bmp";
 
 // The direction of the light source
 const Vector3DF kLight = Vector3DF{{0, 0, -20}}.normalize();
 
 /**
- * A very simple orthographic projection. Drops the Z axis, interpolates from min to max. */
-auto ortho(Vector3DF vert, Vector3DF min, Vector3DF max) -> Vector3DF {
-  Vector3DF delta{{max.x() - min.x(), max.y() - min.y(), max.z() - min.z()}};
-
-  float x = (kBufferWidth - 1) * (vert.x() - min.x()) / delta.x();
-  float y = (kBufferHeight - 1) * (vert.y() - min.y()) / delta.y();
-
-  // Invert the Y values as obj uses a right-hand coordinate system. */
-  y = static_cast<int>(kBufferHeight) - 1 - y;
-
-  return Vector3DF{{x, y, vert.z()}};
+ * A very simple orthographic projection. Keeps the Z axis, maps min to max onto the whole buffer.
+ */
+auto ortho(Vector3DF min, Vector3DF max) -> Matrix4F {
+  const auto width = static_cast<float>(kBufferWidth - 1);
+  const auto height = static_cast<float>(kBufferHeight - 1);
+
+  // Invert the Y values as obj uses a right-hand coordinate system.
+  return translation(Vector3DF{{0, height, 0}}) *
+         scaling(Vector3DF{{width / (max.x() - min.x()), -height / (max.y() - min.y()), 1}}) *
+         translation(Vector3DF{{-min.x(), -min.y(), 0}});
 }
 
 auto main(int argc, char* argv[]) -> int {
   // Parse the command line options
   bool wireframe = false;
   bool terminal = false;
+  bool lod = false;
+  bool compress = false;
   int min_color = kColMax / 2;
   int max_color = kColMax / 2;
   if (argc > 1) {
@@ -52,55 +63,117 @@ auto main(int argc, char* argv[]) -> int {
       if (strcmp(argv[arg_idx], "-t") == 0) {
         terminal = true;
       }
+      if (strcmp(argv[arg_idx], "-l") == 0) {
+        lod = true;
+      }
+      if (strcmp(argv[arg_idx], "-q") == 0) {
+        compress = true;
+      }
     }
   }
 
-  FrameBuffer buffer(kBufferWidth, kBufferHeight);
+  // Tile the buffer's pixels so each triangle touches fewer cache lines, they are put back in order
+  // when the image is written
+  FrameBuffer buffer(kBufferWidth, kBufferHeight, PixelLayout::kTiled);
+  Renderer renderer(buffer);
 
-  std::cout << "Creating " << buffer.width() << "x" << buffer.height() << " frame...\n";
+  std::cout << "Creating " << buffer.width() << "x" << buffer.height() << " frame using "
+            << renderer.threads() << " threads...\n";
 
-  // Load the model
-  const auto model = obj::load("../data/centurion_helmet/centurion_helmet.obj");
+  // Load the model, keeping the vertices as arrays of each coordinate for the batched transform.
+  // Repeat runs load a binary cache of the model, with its normals and bounds, instead of parsing
+  // the .obj again.
+  // The cache only keeps the face order optimised for the vertex cache, the ACMR of the file's
+  // own order is measured when the cache is built and kept with it.
+  float file_acmr = 0;
+  const auto model = cache::loadObj(kModelFile, VertexLayout::kSoA, 0, &file_acmr);
 
-  const auto& verts = model.vertices();
-  const auto& indices = model.vert_indices();
-
-  // Find the min and max values of the verts as we are going the fill the screen with the model
-  Vector3DF min = Vector3DF::max();
-  Vector3DF max = Vector3DF::min();
-  for (const auto& vert : verts) {
-    min = rastrum::min(min, vert);
-    max = rastrum::max(max, vert);
-  }
+  std::cout << "Loaded " << model.face_count()
+            << " triangles, optimising for the vertex cache took the ACMR from " << file_acmr
+            << " to " << acmr(model) << "\n";
 
   // RNG for each poly's color
   std::random_device dev;
   std::mt19937 rng(dev());
   std::uniform_int_distribution<std::mt19937::result_type> dist(min_color, max_color);
 
-  // Project and draw each triangle
-  for (size_t face_idx = 0; face_idx < model.face_count(); ++face_idx) {
-    const auto face = model.face(face_idx);
+  // Fill the screen with the model
+  const auto& bounds = model.bounds();
+  const auto projection = ortho(bounds.min, bounds.max);
+  const Bvh bvh(model);
+
+  // The middle of the frame shows the middle of the model's bounds, look along it from the front
+  const Ray centre{Vector3DF{{bounds.center.x(), bounds.center.y(), bounds.max.z() + 1}},
+                   Vector3DF{{0, 0, -1}}};
+  if (const auto hit = bvh.intersect(model, centre)) {
+    std::cout << "Face " << hit->face_idx << " is at the centre of the frame.\n";
+  }
+
+  // Optionally draw a simpler version of the model that looks the same at the frame's size
+  std::optional<LodChain> lods;
+  if (lod) {
+    lods.emplace(model);
+  }
+  const auto& drawn = lods ? lods->select(projection).model : model;
+  if (lods) {
+    std::cout << "Drawing a level of detail with " << drawn.face_count() << " triangles.\n";
+  }
 
-    if (wireframe) {
-      buffer.triangle(ortho(face[0], min, max), ortho(face[1], min, max), ortho(face[2], min, max),
+  const auto face_normals = drawn.face_normals();
+  const Meshlets meshlets(drawn);
+
+  // Optionally keep only a compressed copy of the model's vertices and indices to draw from
+  std::optional<CompressedModel> compressed;
+  if (compress) {
+    compressed.emplace(drawn);
+    const auto& indices = drawn.vert_indices();
+    std::cout << "Compressed the model from "
+              << (drawn.vertices().size_bytes() + (indices.size() * indices.width())) << " to "
+              << compressed->memory_size() << " bytes.\n";
+  }
+
+  if (wireframe) {
+    // Project and draw each triangle
+    for (size_t face_idx = 0; face_idx < drawn.face_count(); ++face_idx) {
+      const auto face = drawn.face(face_idx);
+      buffer.triangle(projection.transformPoint(face[0]), projection.transformPoint(face[1]),
+                      projection.transformPoint(face[2]),
                       RGBA{(unsigned char)(dist(rng) * 2), (unsigned char)(dist(rng) * 2),
                            (unsigned char)(dist(rng) * 2), kColMax});
-    } else {
+    }
+  } else {
+    const auto shader = [&](size_t face_idx) -> std::optional<RGBA> {
       // Use the dot product of the face's normal for some basic shading
-      const auto norm = normal(face[0], face[1], face[2]).normalize();
-      const auto dot = std::abs(norm.dot(kLight));
-
-      if (dot > 0.0F) {
-        const auto intensity = dot + 1.0F;
-        buffer.fillTriangle(
-            ortho(face[0], min, max), ortho(face[1], min, max), ortho(face[2], min, max),
-            RGBA{(unsigned char)(dist(rng) * intensity), (unsigned char)(dist(rng) * intensity),
-                 (unsigned char)(dist(rng) * intensity), kColMax});
+      const auto dot = std::abs(face_normals[face_idx].dot(kLight));
+
+      if (dot <= 0.0F) {
+        return std::nullopt;
       }
+
+      const auto intensity = dot + 1.0F;
+      return RGBA{(unsigned char)(dist(rng) * intensity), (unsigned char)(dist(rng) * intensity),
+                  (unsigned char)(dist(rng) * intensity), kColMax};
+    };
+
+    if (compressed) {
+      renderer.drawModel(*compressed, projection, shader);
+    } else {
+      // Draw the model a cluster at a time, clusters facing away from the viewer are skipped
+      // without projecting any of their vertices
+      renderer.drawModel(drawn, meshlets, projection, shader);
     }
   }
 
+  // Rasterize the binned triangles
+  renderer.flush();
+
+  if (!wireframe) {
+    const auto& stats = renderer.stats();
+    std::cout << "Culled " << stats.culled() << " of " << stats.submitted << " triangles ("
+              << stats.back_face << " back facing, " << stats.off_screen << " off screen, "
+              << stats.degenerate << " degenerate, " << stats.no_samples << " too small).\n";
+  }
+
   // Output the frame
   if (terminal) {
     buffer.writeConsole();
@@ -0,0 +1,106 @@
+#ifndef RASTRUM_BVH_H
+#define RASTRUM_BVH_H
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "rastrum/Geometry.h"
+#include "rastrum/Model.h"
+#include "rastrum/Vector.h"
+
+namespace rastrum {
+
+/** A ray starting at origin, points along it are origin + t * direction for t >= 0. */
+struct Ray {
+  Vector3DF origin;
+  Vector3DF direction;
+};
+
+/** The nearest face a ray hit. */
+struct RayHit {
+  size_t face_idx = 0;
+  /** The hit point is origin + t * direction. */
+  float t = 0;
+};
+
+/** A node of a Bvh, bounding a contiguous range of its faces. */
+struct BvhNode {
+  Vector3DF min{};
+  Vector3DF max{};
+  /** The node covers Bvh::faces()[first, first + count), for inner nodes every face below it. */
+  uint32_t first = 0;
+  uint32_t count = 0;
+  /** The index of the first of an inner node's two adjacent children, 0 for leaves. */
+  uint32_t children = 0;
+
+  auto leaf() const -> bool;
+};
+
+/**
+ * A bounding volume hierarchy over the faces of a model.
+ * Faces are split using a surface area heuristic evaluated over bins of face centroids, with the
+ * subtrees below the first few levels built in parallel. Faces are reordered so every node's
+ * faces are contiguous, letting queries hand over whole subtrees at once.
+ */
+class Bvh {
+ public:
+  /** The most faces a leaf holds unless they can't be separated. */
+  static constexpr size_t kMaxLeafFaces = 8;
+
+  Bvh() = default;
+
+  /** Builds the hierarchy over a model's faces using up to threads workers (0 uses all cores). */
+  explicit Bvh(const Model& model, size_t threads = 0);
+
+  /** The nodes, the root is first. Empty for a model without faces. */
+  auto nodes() const -> std::span<const BvhNode>;
+
+  /** Indices of the model's faces, in the order the nodes refer to them. */
+  auto faces() const -> std::span<const uint32_t>;
+
+  /**
+   * Calls visit(faces) with the index of every face whose node may be inside the frustum, in
+   * runs as long as possible. Subtrees outside the frustum are skipped, subtrees inside it are
+   * passed whole without testing their children.
+   */
+  template <typename F>
+  void cull(const Frustum& frustum, F&& visit) const {
+    if (_nodes.empty()) {
+      return;
+    }
+
+    std::vector<uint32_t> stack{0};
+    while (!stack.empty()) {
+      const auto& node = _nodes[stack.back()];
+      stack.pop_back();
+
+      const auto containment = frustum.classify(node.min, node.max);
+      if (containment == Containment::kOutside) {
+        continue;
+      }
+
+      if (containment == Containment::kInside || node.leaf()) {
+        visit(faces().subspan(node.first, node.count));
+      } else {
+        stack.push_back(node.children + 1);
+        stack.push_back(node.children);
+      }
+    }
+  }
+
+  /**
+   * Finds the nearest face of model that the ray hits from either side.
+   * The model must be the one the hierarchy was built for.
+   */
+  auto intersect(const Model& model, const Ray& ray) const -> std::optional<RayHit>;
+
+ private:
+  std::vector<BvhNode> _nodes;
+  std::vector<uint32_t> _faces;
+};
+
+}  // namespace rastrum
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef RASTRUM_COMPRESSEDMODEL_H
+#define RASTRUM_COMPRESSEDMODEL_H
+
+#include <cstdint>
+#include <vector>
+
+#include "rastrum/Model.h"
+#include "rastrum/Vector.h"
+
+namespace rastrum {
+
+/**
+ * A model stored compactly for keeping many models in memory at once.
+ * Each vertex coordinate is quantized to 16 bits across the model's bounding box, which takes half
+ * the memory of a float and loses at most half a step, 1/131070 of the box's size on that axis.
+ * Faces are split into blocks of kBlockFaces. Within a block each index is stored as the
+ * difference from the previous one, zigzag encoded and written as a little endian base 128
+ * varint, so indices of a mesh ordered for the vertex cache mostly take a byte or two.
+ * Blocks can be decoded on their own, and quantized coordinates can be transformed directly by
+ * folding dequantization() into the transform, see Renderer::drawModel.
+ */
+class CompressedModel {
+ public:
+  /** The number of faces in each block of encoded indices, the last block may have fewer. */
+  static constexpr size_t kBlockFaces = 128;
+
+  /** The largest quantized coordinate. */
+  static constexpr uint16_t kMaxQuantized = UINT16_MAX;
+
+  explicit CompressedModel(const Model& model);
+
+  auto vertex_count() const -> size_t;
+
+  auto face_count() const -> size_t;
+
+  /** The number of blocks of encoded indices. */
+  auto block_count() const -> size_t;
+
+  /** Maps quantized coordinates to model space, scaling them by the step then adding the min. */
+  auto dequantization() const -> const Matrix4F&;
+
+  /**
+   * Writes count quantized coordinates, starting with vertex first, as floats to separate arrays
+   * of each coordinate, which need not be aligned. Multiply by dequantization() to get model space
+   * vertices.
+   */
+  void decodeVertices(size_t first, size_t count, float* xs, float* ys, float* zs) const;
+
+  /**
+   * Decodes a block's indices into out, which must have room for kBlockFaces * kModelFaceSize of
+   * them. The block holds faces [block * kBlockFaces, block * kBlockFaces + count / 3). Returns
+   * the number of indices written.
+   */
+  auto decodeIndices(size_t block, uint32_t* out) const -> size_t;
+
+  /** Decodes the whole model. Vertices are within half a quantization step of the original. */
+  auto decompress(VertexLayout layout = VertexLayout::kAoS) const -> Model;
+
+  /** The size in bytes of the compressed vertices and indices. */
+  auto memory_size() const -> size_t;
+
+ private:
+  size_t _face_count = 0;
+  Matrix4F _dequantization;
+  /** The quantized coordinates of each vertex, as an array per axis. */
+  std::vector<uint16_t> _xs;
+  std::vector<uint16_t> _ys;
+  std::vector<uint16_t> _zs;
+  /** The encoded indices, block N is _indices[_block_offsets[N], _block_offsets[N + 1]). */
+  std::vector<uint8_t> _indices;
+  std::vector<size_t> _block_offsets;
+};
+
+}  // namespace rastrum
+
+#endif
@@ -1,10 +1,14 @@
 #ifndef RASTRUM_FRAMEBUFFER_H
 #define RASTRUM_FRAMEBUFFER_H
 
+#include <algorithm>
+#include <array>
+#include <cstdint>
 #include <limits>
 #include <string>
 #include <vector>
 
+#include "rastrum/Geometry.h"
 #include "rastrum/Vector.h"
 
 namespace rastrum {
@@ -23,24 +27,147 @@ struct RGBA {
 /** Max value in an RGBA. */
 constexpr auto kColMax = std::numeric_limits<unsigned char>::max();
 
+/** A color stored blue first, the byte order of BMP files and most display surfaces. */
+struct BGRA {
+  unsigned char b = 0;
+  unsigned char g = 0;
+  unsigned char r = 0;
+  unsigned char a = 255;
+};
+
+/** A color with a float per channel, 1 is full intensity but brighter values can be held. */
+struct RGBAF {
+  float r = 0;
+  float g = 0;
+  float b = 0;
+  float a = 1;
+};
+
+// Pixel formats a FrameBuffer can store. Each gives the type stored for a pixel and converts it to
+// and from RGBA, so a buffer's format is fixed at compile time and writing a pixel never checks it.
+
+/** 8 bits per channel in RGBA order, 4 bytes a pixel. */
+struct RGBA8 {
+  using Storage = RGBA;
+
+  static constexpr auto pack(RGBA value) -> Storage {
+    return value;
+  }
+
+  static constexpr auto unpack(Storage value) -> RGBA {
+    return value;
+  }
+};
+
+/** 8 bits per channel in BGRA order, 4 bytes a pixel. */
+struct BGRA8 {
+  using Storage = BGRA;
+
+  static constexpr auto pack(RGBA value) -> Storage {
+    return {value.b, value.g, value.r, value.a};
+  }
+
+  static constexpr auto unpack(Storage value) -> RGBA {
+    return {value.r, value.g, value.b, value.a};
+  }
+};
+
+/** 5 bits of red, 6 of green and 5 of blue packed into 2 bytes a pixel, with no alpha. */
+struct RGB565 {
+  using Storage = uint16_t;
+
+  static constexpr auto pack(RGBA value) -> Storage {
+    return static_cast<Storage>(((value.r >> 3) << 11) | ((value.g >> 2) << 5) | (value.b >> 3));
+  }
+
+  static constexpr auto unpack(Storage value) -> RGBA {
+    // Repeat the high bits in the low ones so full intensity unpacks to kColMax
+    const auto red = static_cast<unsigned>(value >> 11) & 0x1F;
+    const auto green = static_cast<unsigned>(value >> 5) & 0x3F;
+    const auto blue = static_cast<unsigned>(value) & 0x1F;
+    return {static_cast<unsigned char>((red << 3) | (red >> 2)),
+            static_cast<unsigned char>((green << 2) | (green >> 4)),
+            static_cast<unsigned char>((blue << 3) | (blue >> 2)), kColMax};
+  }
+};
+
+/** A float per channel, 16 bytes a pixel, for accumulating high dynamic range color. */
+struct RGBA32F {
+  using Storage = RGBAF;
+
+  static constexpr auto pack(RGBA value) -> Storage {
+    constexpr float kScale = 1.0F / kColMax;
+    return {value.r * kScale, value.g * kScale, value.b * kScale, value.a * kScale};
+  }
+
+  /** Clamps each channel to [0, 1]. */
+  static constexpr auto unpack(Storage value) -> RGBA {
+    const auto channel = [](float value) {
+      return static_cast<unsigned char>((std::clamp(value, 0.0F, 1.0F) * kColMax) + 0.5F);
+    };
+    return {channel(value.r), channel(value.g), channel(value.b), channel(value.a)};
+  }
+};
+
+/** How a FrameBuffer orders its pixels and depths in memory. */
+enum class PixelLayout {
+  /** Row by row, top to bottom. */
+  kLinear,
+  /**
+   * In square tiles of BasicFrameBuffer::kLayoutTileSize pixels, each stored row by row, with the
+   * tiles in turn stored row by row. A small triangle then touches a few cache lines and a single
+   * page rather than a line and a page per row, at the cost of reordering the pixels when they
+   * are read back.
+   */
+  kTiled,
+};
+
 /**
- * Represents a buffer of screen data.
+ * Represents a buffer of screen data, with each pixel stored in the given Format. See FrameBuffer
+ * for the usual RGBA8 buffer. Colors are always passed in as RGBA and converted to the format
+ * once per triangle or pixel, so narrower formats cut the memory written for each frame.
  */
-class FrameBuffer {
+template <typename Format>
+class BasicFrameBuffer {
  public:
+  /** The type stored for each pixel. */
+  using Storage = typename Format::Storage;
+
+  /** Width and height in pixels of the finest tiles in the hierarchical depth buffer. */
+  static constexpr int kDepthTileSize = 8;
+  /** Width and height in fine tiles of each coarse depth tile. */
+  static constexpr int kDepthTileFan = 8;
+  /**
+   * Clip rectangles aligned to multiples of this many pixels share no depth tiles, so they can be
+   * drawn into concurrently.
+   */
+  static constexpr int kTileAlignment = kDepthTileSize * kDepthTileFan;
+  /** Width and height in pixels of the tiles of the kTiled layout, the finest depth tiles. */
+  static constexpr int kLayoutTileSize = kDepthTileSize;
+
   /** Creates a buffer with a specified width and height in pixels. */
-  FrameBuffer(size_t width, size_t height);
+  BasicFrameBuffer(size_t width, size_t height, PixelLayout layout = PixelLayout::kLinear);
 
   auto width() const -> size_t;
   auto height() const -> size_t;
+  auto layout() const -> PixelLayout;
+
+  /**
+   * Gets the raw data for the buffer, in the order of its layout. A linear buffer is indexed left
+   * to right, top to bottom, see linearData() for a tiled one.
+   */
+  auto data() const -> const Storage*;
+
+  /** Copies the pixels out indexed left to right, top to bottom, whatever the layout. */
+  auto linearData() const -> std::vector<Storage>;
 
-  /** Gets the raw data for the buffer. Data is indexed left to right, top to bottom. */
-  auto data() const -> const rastrum::RGBA*;
+  /** Gets the color of a pixel based on linear position, converted to RGBA. */
+  auto color(size_t idx) const -> RGBA;
 
-  /** Set a pixel to the specified value based on linear position. */
+  /** Set a pixel to the specified value based on linear position, writes outside are ignored. */
   void set(size_t idx, RGBA value, float z);
 
-  /** Set a pixel to the specified value based on x/y position. */
+  /** Set a pixel to the specified value based on x/y position, writes outside are ignored. */
   void set(Pixel point, RGBA value, float z);
 
   /** Draws a line from start to end with the specified color and z-order. */
@@ -49,35 +176,115 @@ class FrameBuffer {
   /** Draws a wireframe triangle at the 3 specified points. */
   void triangle(Vector3DF a, Vector3DF b, Vector3DF c, RGBA value);
 
-  /** Draws a filled triangle. */
+  /**
+   * Draws a filled triangle, only triangles wound clockwise on screen are drawn.
+   * Vertices are snapped to 1 / 2^kSubPixelBits of a pixel and a pixel is covered when its whole
+   * coordinate lies inside the triangle. A pixel on an edge shared by two triangles is drawn by
+   * only one. Triangles may extend past the buffer, those reaching beyond the guard band are
+   * clipped.
+   */
   void fillTriangle(Vector3DF a, Vector3DF b, Vector3DF c, RGBA value);
 
-  /** Write the current buffer as a BMP to the specified file. */
+  /**
+   * Draws the part of a filled triangle that lies within the pixel rectangle [clip_min, clip_max).
+   * Pixels outside the rectangle are left untouched so disjoint rectangles can be drawn
+   * concurrently. The triangle must already be clipped to the guard band.
+   */
+  void fillTriangle(Vector3DF a, Vector3DF b, Vector3DF c, RGBA value, Pixel clip_min,
+                    Pixel clip_max);
+
+  /**
+   * Write the current buffer as a BMP to the specified file. Formats other than RGBA8 and BGRA8
+   * are converted to RGBA first.
+   */
   void writeBmp(const std::string& filename) const;
 
   /** Write the current buffer to the terminal. */
   void writeConsole() const;
 
  private:
+  /** Vertices are scaled by this then rounded to integers before rasterizing. */
+  static constexpr int64_t kSubPixelScale = int64_t{1} << kSubPixelBits;
+  /** Vertices further than this from the origin can't be rasterized without overflow. */
+  static constexpr float kMaxCoord = 1 << 21;
+
+  /**
+   * An edge equation evaluated at whole pixels, e(x, y) = dx * x + dy * y + offset.
+   * Pixels with e >= 0 are inside the edge, with ties already broken by the fill rule.
+   */
+  struct EdgeSetup {
+    int64_t dx;
+    int64_t dy;
+    int64_t offset;
+  };
+
+  /** Per-triangle edge and depth equations used by the rasterizer. */
+  struct TriangleSetup {
+    /** The edges ab, bc and ca. */
+    std::array<EdgeSetup, 3> edges;
+    Storage value;
+    /** Depth is z_origin + z_dx * (x - origin.x) + z_dy * (y - origin.y). */
+    Pixel origin;
+    float z_origin;
+    float z_dx;
+    float z_dy;
+    float min_z;
+    float max_z;
+  };
+
+  /** Gets the index in _data and _z_buffer of the pixel at x/y. */
+  auto index(size_t x, size_t y) const -> size_t;
+
+  /** Rasterizes the part of a set up triangle within the rectangle [min, max). */
+  void rasterize(const TriangleSetup& tri, Pixel min, Pixel max);
+
+  /** Depth tests and sets a pixel without checking bounds or updating the depth tiles. */
+  void testAndSet(size_t idx, Storage value, float z);
+
+  /**
+   * Indicates if the triangle is behind every pixel in the depth tile containing x/y.
+   * Level 0 tests the finest tiles, level 1 the coarse tiles.
+   */
+  auto occluded(const TriangleSetup& tri, int x, int y, int level) -> bool;
+
+  /** Updates the depth tiles after a triangle has been drawn in the rectangle [min, max). */
+  void updateDepthTiles(const TriangleSetup& tri, Pixel min, Pixel max);
+
   /** Line drawing for slopes between 0 and -1. */
   void lineLow(Vector3DF start, Vector3DF end, RGBA value);
   /** Line drawing for positive or negative steep slopes. */
   void lineHigh(Vector3DF start, Vector3DF end, RGBA value);
 
-  /**
-   * Edge function, calculates which "side" a point p lies on the edge ab.
-   * Positive = right
-   * Zero = on the edge
-   * Negative = left
-   */
-  static auto edge(Vector3DF a, Vector3DF b, Vector3DF p) -> float;
-
   size_t _width;
   size_t _height;
-  std::vector<RGBA> _data;
+  PixelLayout _layout;
+  std::vector<Storage> _data;
   std::vector<float> _z_buffer;
+  /** The number of tiles across each row of the kTiled layout. */
+  size_t _layout_tiles_x;
+
+  // A two level hierarchical depth buffer, kept conservative as depth is written so whole tiles
+  // of a triangle can be rejected before any per-pixel work.
+  size_t _depth_tiles_x;
+  size_t _depth_tiles_y;
+  size_t _coarse_tiles_x;
+  size_t _coarse_tiles_y;
+  // Each tile holds a depth no pixel in it is further back than, only raised when a triangle
+  // covers the whole tile. Pixels only ever move forward so other writes leave it a lower bound.
+  std::vector<float> _depth_tiles;
+  std::vector<float> _coarse_tiles;
+  /** Coarse tiles whose depth needs refreshing from their children. */
+  std::vector<unsigned char> _coarse_dirty;
 };
 
+extern template class BasicFrameBuffer<RGBA8>;
+extern template class BasicFrameBuffer<BGRA8>;
+extern template class BasicFrameBuffer<RGB565>;
+extern template class BasicFrameBuffer<RGBA32F>;
+
+/** A buffer storing 8 bit RGBA pixels. */
+using FrameBuffer = BasicFrameBuffer<RGBA8>;
+
 }  // namespace rastrum
 
 #endif
\ No newline at end of file
@@ -0,0 +1,280 @@
+#ifndef RASTRUM_GEOMETRY_H
+#define RASTRUM_GEOMETRY_H
+
+#include <array>
+#include <cstddef>
+#include <limits>
+
+#include "rastrum/Vector.h"
+
+namespace rastrum {
+
+/**
+ * How far in pixels triangles may extend past the edges of the viewport before they are clipped.
+ * Triangles within the guard band are cheaper to rasterize than to clip, as the rasterizer only
+ * visits the pixels inside the viewport.
+ */
+constexpr float kGuardBand = 1 << 16;
+
+/** Number of fractional bits of a pixel that vertices are snapped to before rasterizing. */
+constexpr int kSubPixelBits = 8;
+
+/**
+ * The smallest w kept when clipping in homogeneous coordinates, see clipDepth. Points any nearer
+ * the plane through the viewer project too far out to divide safely.
+ */
+constexpr float kMinClipW = 1.0F / (1 << 20);
+
+/** Axis aligned bounds to clip against, points with min <= p <= max on every axis are kept. */
+struct ClipBounds {
+  Vector3DF min;
+  Vector3DF max;
+
+  /** Indicates if a point is within the bounds. */
+  auto contains(const Vector3DF& point) const -> bool;
+};
+
+/** A convex polygon produced by clipping a triangle, vertices keep the triangle's winding. */
+struct ClippedPolygon {
+  /** Each of the six clip planes can add at most one vertex to a triangle. */
+  static constexpr size_t kMaxVerts = 9;
+
+  std::array<Vector3DF, kMaxVerts> verts;
+  size_t count = 0;
+};
+
+/** Clips a triangle to the bounds, the polygon is empty if the triangle is outside them. */
+auto clip(Vector3DF a, Vector3DF b, Vector3DF c, const ClipBounds& bounds) -> ClippedPolygon;
+
+/**
+ * Clips a triangle in homogeneous coordinates, before they are divided by w, to w >= kMinClipW
+ * and min_z <= z / w <= max_z, then divides the polygon's vertices by their w. Infinite limits
+ * don't add a plane. The polygon is empty if the triangle is outside the planes, such as when it
+ * is entirely behind the viewer.
+ */
+auto clipDepth(Vector4DF a, Vector4DF b, Vector4DF c, float min_z, float max_z) -> ClippedPolygon;
+
+/**
+ * Bounds the directions of a group of face normals, the normal n of every face in the group has
+ * n.dot(axis) >= cos_angle. Cones with cos_angle <= 0 span a hemisphere or more, so bound nothing
+ * useful.
+ */
+struct NormalCone {
+  Vector3DF axis{{0, 0, 1}};
+  float cos_angle = -1;
+};
+
+/** How much of a box or sphere lies within a Frustum. */
+enum class Containment {
+  kOutside,
+  kIntersects,
+  kInside,
+};
+
+/**
+ * The region of model space that a transform, such as viewport * projection * view * model, maps
+ * into screen space bounds. Boxes are tested against its planes in model space, so whole groups of
+ * faces can be rejected without transforming any of their vertices.
+ */
+class Frustum {
+ public:
+  /**
+   * Creates the frustum of points that transform maps into bounds and in front of the viewer.
+   * Infinite bounds don't add a plane.
+   */
+  Frustum(const Matrix4F& transform, const ClipBounds& bounds);
+
+  /**
+   * Classifies an axis aligned box. The test is conservative, boxes near the frustum's corners
+   * can be reported as intersecting when they are outside.
+   */
+  auto classify(const Vector3DF& min, const Vector3DF& max) const -> Containment;
+
+  /** Classifies a sphere, also conservatively. */
+  auto classify(const Vector3DF& center, float radius) const -> Containment;
+
+  /**
+   * Indicates whether every face within a sphere whose normal lies within the cone is wound
+   * anti-clockwise on screen, so would be culled as back facing. Normals are the cross product of
+   * a face's second and third vertices relative to its first. Faces that reach behind the viewer
+   * may be included, the part of them in front of the viewer is wound the same way.
+   */
+  auto facesAway(const Vector3DF& center, float radius, const NormalCone& cone) const -> bool;
+
+ private:
+  /** Points with plane.x() * x + plane.y() * y + plane.z() * z + plane.w() >= 0 are inside. */
+  std::array<Vector4DF, 7> _planes;
+  size_t _count = 0;
+  /**
+   * A face at p with normal n is wound clockwise on screen when n.dot(view(p)) < 0, where
+   * view(p) is _view.xyz + _view.w * p. That's the direction from the viewer to p, scaled by the
+   * transform's handedness, for perspective transforms and a fixed view direction for parallel
+   * ones.
+   */
+  Vector4DF _view;
+};
+
+/** The reason the geometry stage rejected a triangle. */
+enum class Cull {
+  /** The triangle was not culled. */
+  kNone,
+  /** The triangle is entirely outside the viewport. */
+  kOffScreen,
+  /**
+   * The triangle is entirely nearer than the near plane, further than the far plane or behind the
+   * viewer, or has a vertex that isn't a number.
+   */
+  kOutsideDepth,
+  /** The triangle has no area. */
+  kDegenerate,
+  /** The triangle is wound anti-clockwise on screen, so faces away from the viewer. */
+  kBackFace,
+  /** The triangle is too small to cover any pixel's sample point. */
+  kNoSamples,
+};
+
+/** Counts of the triangles seen by a geometry stage. */
+struct CullStats {
+  size_t submitted = 0;
+  size_t off_screen = 0;
+  size_t outside_depth = 0;
+  size_t degenerate = 0;
+  size_t back_face = 0;
+  size_t no_samples = 0;
+  /** Triangles that were kept but had to be clipped. */
+  size_t clipped = 0;
+
+  /** The number of triangles that were rejected for any reason. */
+  auto culled() const -> size_t;
+};
+
+/**
+ * Rejects screen space triangles that can't contribute any pixels before they are rasterized,
+ * then clips the remainder. Triangles that cross the near or far planes, or reach behind the
+ * viewer, are clipped in homogeneous coordinates before the divide by w, see clipDepth. The guard
+ * band is only clipped against on screen, on x and y.
+ * Uses the same conventions as FrameBuffer::fillTriangle, pixels are sampled at whole coordinates
+ * and only triangles wound clockwise on screen are front facing.
+ */
+class GeometryStage {
+ public:
+  /** Creates a stage for a viewport with a specified width and height in pixels. */
+  GeometryStage(size_t width, size_t height);
+
+  /**
+   * Sets the range of depths that are kept, by default no depths are clipped.
+   * Larger depths are nearer the viewer, so max_z is the near plane and min_z the far plane.
+   */
+  void setDepthRange(float min_z, float max_z);
+
+  /** The viewport and depth range, triangles entirely outside it are culled. */
+  auto viewport() const -> ClipBounds;
+
+  /**
+   * Classifies a cluster of face_count faces within a sphere whose normals lie within the cone,
+   * recording the result in the stats if the whole cluster is culled as off screen or back
+   * facing. Clusters that aren't culled have their faces classified one by one.
+   */
+  auto cullCluster(const Frustum& frustum, const Vector3DF& center, float radius,
+                   const NormalCone& cone, size_t face_count) -> Cull;
+
+  /** Classifies a triangle and records the result in the stats. */
+  auto cull(Vector3DF a, Vector3DF b, Vector3DF c) -> Cull;
+
+  /**
+   * Culls a screen space triangle and clips it if needed, calling emit(a, b, c) for each resulting
+   * triangle. Triangles that don't need clipping are passed through unchanged. The vertices are
+   * treated as having w = 1 when they are clipped to the depth range.
+   */
+  template <typename F>
+  void process(Vector3DF a, Vector3DF b, Vector3DF c, F&& emit) {
+    const auto homogeneous = [](const Vector3DF& vert) {
+      return Vector4DF{{vert.x(), vert.y(), vert.z(), 1}};
+    };
+    process(
+        a, b, c, [&]() { return std::array{homogeneous(a), homogeneous(b), homogeneous(c)}; },
+        emit);
+  }
+
+  /**
+   * Culls and clips a triangle that was projected by dividing homogeneous vertices by their w,
+   * as above. Vertices behind the viewer may be NaN, as transformPoints leaves them. Triangles
+   * with a vertex outside the depth range or behind the viewer are clipped before the divide,
+   * with the std::array of homogeneous vertices returned by homogeneous(), which is only called
+   * then.
+   */
+  template <typename H, typename F>
+  void process(Vector3DF a, Vector3DF b, Vector3DF c, H&& homogeneous, F&& emit) {
+    // NaN vertices fail the comparisons, so they are clipped too
+    const auto in_depth = [this](const Vector3DF& vert) {
+      return vert.z() >= _min_z && vert.z() <= _max_z;
+    };
+    if (in_depth(a) && in_depth(b) && in_depth(c)) {
+      if (cull(a, b, c) == Cull::kNone && emitGuarded(a, b, c, emit)) {
+        ++_stats.clipped;
+      }
+      return;
+    }
+
+    ++_stats.submitted;
+    const auto [clip_a, clip_b, clip_c] = homogeneous();
+    const auto polygon = clipDepth(clip_a, clip_b, clip_c, _min_z, _max_z);
+    if (record(classify(polygon)) != Cull::kNone) {
+      return;
+    }
+
+    ++_stats.clipped;
+    for (size_t idx = 2; idx < polygon.count; ++idx) {
+      emitGuarded(polygon.verts[0], polygon.verts[idx - 1], polygon.verts[idx], emit);
+    }
+  }
+
+  /** Gets the counts of triangles classified since the last reset. */
+  auto stats() const -> const CullStats&;
+
+  /** Resets the counts to zero. */
+  void resetStats();
+
+ private:
+  /** Classifies a triangle without recording the result. */
+  auto classify(Vector3DF a, Vector3DF b, Vector3DF c) const -> Cull;
+
+  /** Classifies a polygon clipped to the depth range, it is outside it if it's empty. */
+  auto classify(const ClippedPolygon& polygon) const -> Cull;
+
+  /** Indicates whether a bounding box contains any pixel's sample point. */
+  static auto coversSamples(float min_x, float max_x, float min_y, float max_y) -> bool;
+
+  /** Counts a triangle that was classified under the reason it was culled, if any. */
+  auto record(Cull result) -> Cull;
+
+  /**
+   * Calls emit with a triangle, clipped to the guard band on x and y if it extends past it.
+   * Returns whether it was clipped.
+   */
+  template <typename F>
+  auto emitGuarded(Vector3DF a, Vector3DF b, Vector3DF c, F& emit) const -> bool {
+    if (_guard_band.contains(a) && _guard_band.contains(b) && _guard_band.contains(c)) {
+      emit(a, b, c);
+      return false;
+    }
+
+    const auto polygon = clip(a, b, c, _guard_band);
+    for (size_t idx = 2; idx < polygon.count; ++idx) {
+      emit(polygon.verts[0], polygon.verts[idx - 1], polygon.verts[idx]);
+    }
+    return true;
+  }
+
+  float _max_x;
+  float _max_y;
+  float _min_z = -std::numeric_limits<float>::infinity();
+  float _max_z = std::numeric_limits<float>::infinity();
+  /** The guard band, it has no limits on z. */
+  ClipBounds _guard_band;
+  CullStats _stats;
+};
+
+}  // namespace rastrum
+
+#endif
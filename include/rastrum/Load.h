@@ -0,0 +1,37 @@
+#ifndef RASTRUM_LOAD_H
+#define RASTRUM_LOAD_H
+
+#include <string>
+#include <string_view>
+
+#include "rastrum/Model.h"
+
+namespace rastrum {
+
+/** The model file formats load() reads. */
+enum class ModelFormat {
+  /** Text .obj, see obj::load. */
+  kObj,
+  /** Binary .stl, see stl::load. */
+  kStl,
+  /** Binary .ply, see ply::load. */
+  kPly,
+};
+
+/**
+ * Identifies the format of a model file from its contents rather than its extension. Text STL
+ * files are identified as kStl so they are rejected rather than read as an empty .obj, and
+ * anything else that isn't PLY is assumed to be .obj.
+ */
+auto detectFormat(std::string_view contents) -> ModelFormat;
+
+/**
+ * Loads a model from a .obj, binary .stl or binary .ply file, detecting which it is with
+ * detectFormat() and passing the arguments on to that format's load().
+ */
+auto load(const std::string& filename, VertexLayout layout = VertexLayout::kAoS,
+          size_t threads = 0) -> Model;
+
+}  // namespace rastrum
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef RASTRUM_LOD_H
+#define RASTRUM_LOD_H
+
+#include <span>
+#include <vector>
+
+#include "rastrum/Model.h"
+#include "rastrum/Vector.h"
+
+namespace rastrum {
+
+/** Each level of a LodChain has about this many times fewer faces than the one before. */
+constexpr size_t kLodReduction = 4;
+
+/** A LodChain stops before a level with fewer faces than this. */
+constexpr size_t kMinLodFaces = 256;
+
+/** The most a level's error may cover on screen, in pixels, for LodChain::select to pick it. */
+constexpr float kLodPixelError = 1;
+
+/** A simplified version of a model. */
+struct Lod {
+  Model model;
+  /** Roughly how far the level's surface strays from the original's, in model units. */
+  float error = 0;
+};
+
+/**
+ * Simplifies a model to at most target_faces faces by collapsing edges in order of their quadric
+ * error (Garland and Heckbert), always keeping one of each edge's vertices in place.
+ * Collapses that would fold a face over or change the model's topology are skipped, so the
+ * result can have more faces than asked for. Faces that use a vertex twice are dropped. The
+ * result is precomputed if model was.
+ */
+auto simplify(const Model& model, size_t target_faces) -> Lod;
+
+/**
+ * A model and progressively simpler versions of it, so objects can be drawn with a number of
+ * faces that suits how large they appear rather than how detailed they are.
+ * Levels are snapshots of a single simplification run, so later levels are never built from a
+ * previous level's approximations.
+ */
+class LodChain {
+ public:
+  /** Builds levels down to min_faces faces, the first level is the model itself. */
+  explicit LodChain(const Model& model, size_t min_faces = kMinLodFaces);
+
+  /** The levels, from the most to least detailed. */
+  auto levels() const -> std::span<const Lod>;
+
+  /**
+   * Picks the simplest level whose error spans at most max_error pixels once transformed onto
+   * the target frame buffer, e.g. by viewport * projection * view * model. The scale is measured
+   * across the model's bounding sphere, the full model is picked if any of it is behind the
+   * viewer.
+   */
+  auto select(const Matrix4F& transform, float max_error = kLodPixelError) const -> const Lod&;
+
+ private:
+  std::vector<Lod> _levels;
+  Vector3DF _center;
+  float _radius = 0;
+};
+
+}  // namespace rastrum
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef RASTRUM_MESHLET_H
+#define RASTRUM_MESHLET_H
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "rastrum/Geometry.h"
+#include "rastrum/Model.h"
+#include "rastrum/Vector.h"
+
+namespace rastrum {
+
+/** A small cluster of neighbouring faces of a model, see Meshlets. */
+struct Meshlet {
+  /** The cluster's vertices are Meshlets::vertices()[vertex_offset, vertex_offset + count). */
+  uint32_t vertex_offset = 0;
+  uint32_t vertex_count = 0;
+  /** Its faces are Meshlets::faces()[face_offset, face_offset + face_count). */
+  uint32_t face_offset = 0;
+  uint32_t face_count = 0;
+  /** A sphere containing every vertex. */
+  Vector3DF center;
+  float radius = 0;
+  /** Bounds the normals of the faces. */
+  NormalCone cone;
+};
+
+/**
+ * A model split into clusters of at most kMaxVertices vertices and kMaxFaces faces.
+ * Each cluster is grown from a seed face by repeatedly adding the neighbouring face that needs
+ * the fewest new vertices and is nearest the cluster, so clusters are compact and mostly flat.
+ * Their bounding spheres and normal cones let a whole cluster be culled as off screen or back
+ * facing before any of its vertices are transformed.
+ */
+class Meshlets {
+ public:
+  static constexpr size_t kMaxVertices = 64;
+  static constexpr size_t kMaxFaces = 124;
+
+  Meshlets() = default;
+
+  explicit Meshlets(const Model& model);
+
+  auto meshlets() const -> std::span<const Meshlet>;
+
+  /** The index in the model of each cluster's vertices. */
+  auto vertices() const -> std::span<const uint32_t>;
+
+  /** The index in the model of each cluster's faces. */
+  auto faces() const -> std::span<const uint32_t>;
+
+  /** kModelFaceSize indices per face into its cluster's vertices. */
+  auto indices() const -> std::span<const uint8_t>;
+
+ private:
+  std::vector<Meshlet> _meshlets;
+  std::vector<uint32_t> _vertices;
+  std::vector<uint32_t> _faces;
+  std::vector<uint8_t> _indices;
+};
+
+}  // namespace rastrum
+
+#endif
@@ -2,6 +2,14 @@
 #define RASTRUM_MODEL_H
 
 #include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <optional>
+#include <span>
+#include <variant>
 #include <vector>
 
 #include "rastrum/Vector.h"
@@ -10,22 +18,188 @@ namespace rastrum {
 
 constexpr int kModelFaceSize = 3;
 
+/** Allocates storage for a std::vector aligned to Alignment bytes. */
+template <typename T, size_t Alignment>
+struct AlignedAllocator {
+  using value_type = T;
+
+  template <typename U>
+  struct rebind {
+    using other = AlignedAllocator<U, Alignment>;
+  };
+
+  AlignedAllocator() = default;
+  template <typename U>
+  AlignedAllocator(const AlignedAllocator<U, Alignment>& /*other*/) {
+  }
+
+  auto allocate(size_t count) -> T* {
+    return static_cast<T*>(::operator new(count * sizeof(T), std::align_val_t{Alignment}));
+  }
+
+  void deallocate(T* ptr, size_t /*count*/) {
+    ::operator delete(ptr, std::align_val_t{Alignment});
+  }
+
+  template <typename U>
+  auto operator==(const AlignedAllocator<U, Alignment>& /*other*/) const -> bool {
+    return true;
+  }
+};
+
+/** Alignment in bytes of a model's structure of arrays vertices, a cache line. */
+constexpr size_t kVertexAlignment = 64;
+
+/** A vector of floats aligned for SIMD loads. */
+using AlignedFloats = std::vector<float, AlignedAllocator<float, kVertexAlignment>>;
+
+/** How a model stores its vertices. */
+enum class VertexLayout {
+  /** Only as an array of Vector3DF. */
+  kAoS,
+  /** Also as separate, aligned arrays of each coordinate for streaming through SIMD. */
+  kSoA,
+};
+
+/** Vertices stored as a structure of arrays, each array is kVertexAlignment aligned. */
+struct VertexArrays {
+  std::span<const float> x;
+  std::span<const float> y;
+  std::span<const float> z;
+
+  auto size() const -> size_t;
+};
+
+/**
+ * A model's vertex indices stored as 16 or 32 bit integers.
+ * Indexing and iterating give size_t like a std::vector<size_t> would. Hot loops should use
+ * visit() to get at the underlying integers without checking the width on every access.
+ */
+class IndexBuffer {
+ public:
+  /** Iterates the indices as size_t values. */
+  class Iterator {
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = size_t;
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using reference = size_t;
+
+    Iterator() = default;
+    Iterator(const IndexBuffer* buffer, size_t idx) : _buffer(buffer), _idx(idx) {
+    }
+
+    auto operator*() const -> size_t {
+      return (*_buffer)[_idx];
+    }
+
+    auto operator++() -> Iterator& {
+      ++_idx;
+      return *this;
+    }
+
+    auto operator++(int) -> Iterator {
+      auto previous = *this;
+      ++_idx;
+      return previous;
+    }
+
+    auto operator==(const Iterator& other) const -> bool = default;
+
+   private:
+    const IndexBuffer* _buffer = nullptr;
+    size_t _idx = 0;
+  };
+
+  IndexBuffer() = default;
+
+  /** Stores indices using the narrowest width that can address vertex_count vertices. */
+  IndexBuffer(const std::vector<size_t>& indices, size_t vertex_count);
+
+  /** Narrows 32 bit indices to 16 bits if they can address vertex_count vertices. */
+  IndexBuffer(std::vector<uint32_t> indices, size_t vertex_count);
+
+  explicit IndexBuffer(std::vector<uint16_t> indices);
+  explicit IndexBuffer(std::vector<uint32_t> indices);
+
+  /** Views indices owned by storage without copying them. */
+  IndexBuffer(std::span<const uint16_t> indices, std::shared_ptr<const void> storage);
+  IndexBuffer(std::span<const uint32_t> indices, std::shared_ptr<const void> storage);
+
+  auto operator[](size_t idx) const -> size_t;
+
+  auto begin() const -> Iterator;
+  auto end() const -> Iterator;
+
+  auto size() const -> size_t;
+
+  /** The size in bytes of each index. */
+  auto width() const -> size_t;
+
+  /** Calls fn with a std::span of the underlying uint16_t or uint32_t indices. */
+  template <typename F>
+  auto visit(F&& fn) const -> decltype(auto) {
+    return std::visit([&](auto indices) -> decltype(auto) { return fn(indices); }, _indices);
+  }
+
+ private:
+  /** Takes ownership of indices. */
+  template <typename T>
+  void assign(std::vector<T> indices);
+
+  /** Keeps the memory the indices view alive, shared between copies of the buffer. */
+  std::shared_ptr<const void> _storage;
+  std::variant<std::span<const uint16_t>, std::span<const uint32_t>> _indices;
+};
+
+/** An axis aligned box and a sphere that each contain every vertex of a model. */
+struct Bounds {
+  Vector3DF min{{0, 0, 0}};
+  Vector3DF max{{0, 0, 0}};
+  Vector3DF center{{0, 0, 0}};
+  float radius = 0;
+};
+
+/** Data derived from a model's vertices and faces, see Model::precompute(). */
+struct Precomputed {
+  /** The unit normal of each face. */
+  std::span<const Vector3DF> face_normals;
+  /** The unit normal of each vertex, the area weighted average of the normals of its faces. */
+  std::span<const Vector3DF> vertex_normals;
+  Bounds bounds;
+};
+
 /**
  * Represents a loaded model.
  * A model is represented by:
  * - Vertices - a list of all the vertices used in the model
  * - Vertex indices - Groups of kModelFaceSize indices into the vertices
  *   that describe a face of the model.
+ * A model never changes once created, so copies share its storage.
  */
 class Model {
  public:
-  Model(std::vector<Vector3DF> vertices, std::vector<size_t> vert_indices);
+  Model(std::vector<Vector3DF> vertices, std::vector<size_t> vert_indices,
+        VertexLayout layout = VertexLayout::kAoS);
+
+  Model(std::vector<Vector3DF> vertices, IndexBuffer vert_indices,
+        VertexLayout layout = VertexLayout::kAoS);
+
+  /** Creates a model viewing vertices owned by storage without copying them. */
+  Model(std::span<const Vector3DF> vertices, std::shared_ptr<const void> storage,
+        IndexBuffer vert_indices, VertexLayout layout = VertexLayout::kAoS);
 
   /** Gets the raw verts for the model. */
-  auto vertices() const -> const std::vector<Vector3DF>&;
+  auto vertices() const -> std::span<const Vector3DF>;
+
+  /** Gets the raw verts as separate coordinate arrays, empty unless the layout is kSoA. */
+  auto vertex_arrays() const -> const VertexArrays&;
+
+  auto layout() const -> VertexLayout;
 
   /** Gets the raw indices for the model. */
-  auto vert_indices() const -> const std::vector<size_t>&;
+  auto vert_indices() const -> const IndexBuffer&;
 
   /** Indicates how many faces are in the model. */
   auto face_count() const -> size_t;
@@ -33,11 +207,42 @@ class Model {
   /** Gets the verts for the specified face. */
   auto face(size_t idx) const -> std::array<Vector3DF, kModelFaceSize>;
 
+  /**
+   * Computes the face normals, vertex normals and bounds of the model once, so they can be read
+   * as often as needed. Copies of the model made afterwards share them.
+   */
+  void precompute();
+
+  /** Uses precomputed data owned by storage, such as a cache, rather than computing it. */
+  void precompute(Precomputed precomputed, std::shared_ptr<const void> storage);
+
+  /** Indicates whether precompute() has been called. */
+  auto precomputed() const -> bool;
+
+  // Precomputed data, terminates if precompute() hasn't been called
+
+  auto face_normals() const -> std::span<const Vector3DF>;
+  auto vertex_normals() const -> std::span<const Vector3DF>;
+  auto bounds() const -> const Bounds&;
+
  private:
-  std::vector<Vector3DF> _vertices;
-  std::vector<size_t> _vert_indices;
+  /**
+   * Validates the indices, terminating unless they make whole faces of existing vertices, and
+   * builds the vertex arrays for the layout.
+   */
+  void init();
+
+  /** Keeps the memory the vertices view alive, shared between copies of the model. */
+  std::shared_ptr<const void> _storage;
+  std::span<const Vector3DF> _vertices;
+  std::shared_ptr<const void> _array_storage;
+  VertexArrays _vertex_arrays;
+  VertexLayout _layout;
+  IndexBuffer _vert_indices;
+  std::shared_ptr<const void> _precomputed_storage;
+  std::optional<Precomputed> _precomputed;
 };
 
 }  // namespace rastrum
 
-#endif
\ No newline at end of file
+#endif
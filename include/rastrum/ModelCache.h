@@ -0,0 +1,57 @@
+#ifndef RASTRUM_MODELCACHE_H
+#define RASTRUM_MODELCACHE_H
+
+#include <cstdint>
+#include <optional>
+#include <string>
+
+#include "rastrum/Model.h"
+
+namespace rastrum::cache {
+
+/** Identifies the version of a source file a cache was built from. */
+struct SourceKey {
+  uint64_t size = 0;
+  int64_t mtime = 0;
+
+  auto operator==(const SourceKey& other) const -> bool = default;
+};
+
+/** Gets the key of a source file as it is now. */
+auto sourceKey(const std::string& filename) -> SourceKey;
+
+/**
+ * Writes a model to a binary cache file tagged with the key of the file it was built from, and the
+ * ACMR the source had before its faces were reordered, if known (see acmr()).
+ * The file holds a header followed by the vertices, indices and any precomputed data exactly as a
+ * Model stores them, each aligned to kVertexAlignment, so it can be used in place by load(). It
+ * uses the native byte order and is only meant to be read back on the same machine.
+ * Returns false if the file couldn't be written.
+ */
+auto save(const Model& model, const std::string& filename, SourceKey key = {},
+          float source_acmr = 0) -> bool;
+
+/**
+ * Maps a cache file written by save() and returns a model that views it without copying.
+ * Returns nothing if the file is missing, damaged, from another version of the format or built
+ * from a source that doesn't match key (the key is not checked when it isn't given).
+ * If source_acmr is given it is set to the ACMR recorded by save().
+ */
+auto load(const std::string& filename, std::optional<SourceKey> key = std::nullopt,
+          VertexLayout layout = VertexLayout::kAoS, float* source_acmr = nullptr)
+    -> std::optional<Model>;
+
+/**
+ * Loads a .obj file through a cache stored next to it as filename + ".cache".
+ * The cache is rebuilt whenever it is missing or the .obj's size or modification time changed,
+ * otherwise the .obj isn't read at all. The model is optimised for the vertex cache and
+ * precomputed before it's saved, so repeat loads get its face order, normals and bounds for free.
+ * If source_acmr is given it is set to the ACMR of the .obj's own face order, which is measured
+ * when the cache is built and kept in it. See obj::load for the other arguments.
+ */
+auto loadObj(const std::string& filename, VertexLayout layout = VertexLayout::kAoS,
+             size_t threads = 0, float* source_acmr = nullptr) -> Model;
+
+}  // namespace rastrum::cache
+
+#endif
@@ -1,6 +1,12 @@
 #ifndef RASTRUM_OBJLOADER_H
 #define RASTRUM_OBJLOADER_H
 
+#include <functional>
+#include <future>
+#include <memory>
+#include <optional>
+#include <span>
+#include <stdexcept>
 #include <string>
 
 #include "rastrum/Model.h"
@@ -11,10 +17,104 @@ namespace rastrum::obj {
  * Loads a .obj file and returns the loaded model.
  * Only supports a small subset of the .obj format:
  *  - XYZ vertices (other values are ignored, terminates if XYZ not provided)
- *  - 3 sided faces (other values cause termination)
+ *  - Faces with 3 or more sides, given as v, v/vt, v//vn or v/vt/vn for each vertex. Only the
+ *    vertex index is used, it may be negative to count back from the last vertex. Faces with
+ *    more than 3 sides are split into triangles by ear clipping.
  * All other parts of the file are ignored.
+ * Vertices with identical positions are welded together, so the model has no duplicates.
+ * The file is memory mapped and parsed in place, so loading needs no memory beyond the model.
+ * Large files are split into chunks of whole lines that are parsed by up to threads workers
+ * (0 uses all cores).
+ * The model stores its vertices with the specified layout.
  */
-auto load(const std::string& filename) -> Model;
+auto load(const std::string& filename, VertexLayout layout = VertexLayout::kAoS,
+          size_t threads = 0) -> Model;
+
+/** An error in a .obj file, or in opening it, raised by a load started with loadAsync(). */
+class LoadError : public std::runtime_error {
+ public:
+  using std::runtime_error::runtime_error;
+};
+
+struct LoadProgress;
+
+/** Tracks a load started by loadAsync(). */
+class LoadHandle {
+ public:
+  /** Cancels the load if the model hasn't been collected, waiting for the load to stop. */
+  ~LoadHandle();
+
+  LoadHandle(LoadHandle&&) = default;
+
+  /** Cancels this handle's load if the model hasn't been collected, then takes over other's. */
+  auto operator=(LoadHandle&& other) noexcept -> LoadHandle&;
+
+  /**
+   * Waits for the load to finish and returns the model, or nothing if it was cancelled.
+   * Throws LoadError if the file couldn't be opened or has an error. Can only be called once.
+   */
+  auto get() -> std::optional<Model>;
+
+  /** Whether the load has finished, so get() won't block. */
+  auto ready() const -> bool;
+
+  /** The number of bytes of the file parsed so far, after a quicker pass that counts records. */
+  auto bytesLoaded() const -> size_t;
+
+  /** The size of the file, 0 until it has been opened. */
+  auto bytesTotal() const -> size_t;
+
+  /** Asks the load to stop, it stops at the next chunk of the file. */
+  void cancel();
+
+ private:
+  friend auto loadAsync(const std::string& filename, VertexLayout layout, size_t threads)
+      -> LoadHandle;
+
+  LoadHandle(std::future<std::optional<Model>> model, std::shared_ptr<LoadProgress> progress);
+
+  std::shared_ptr<LoadProgress> _progress;
+  std::future<std::optional<Model>> _model;
+};
+
+/**
+ * Starts loading a .obj file with load() on a background thread and returns straight away.
+ * The caller can keep working, poll the progress and collect the model from the handle. Unlike
+ * load(), errors don't terminate, they are raised as a LoadError from LoadHandle::get().
+ */
+auto loadAsync(const std::string& filename, VertexLayout layout = VertexLayout::kAoS,
+               size_t threads = 0) -> LoadHandle;
+
+/** Default size of the chunks stream() reads a file in. */
+constexpr size_t kStreamChunkSize = size_t{1} << 20;
+
+/** The number of triangles stream() passes to StreamHandler::faces at once. */
+constexpr size_t kStreamFaceBatch = 4096;
+
+/** Receives the records of a .obj file from stream(), members left empty are skipped. */
+struct StreamHandler {
+  /** Called for each vertex in the order they appear in the file, idx counts up from 0. */
+  std::function<void(size_t idx, const Vector3DF& vertex)> vertex;
+
+  /**
+   * Called with batches of triangles as groups of kModelFaceSize vertex indices. The indices
+   * only refer to vertices that have already been passed to vertex.
+   */
+  std::function<void(std::span<const uint32_t> indices)> faces;
+};
+
+/**
+ * Reads a .obj file, calling handler for each record as it is read rather than building a Model.
+ * The file is read chunk_size bytes at a time, so memory use is bounded by chunk_size (or the
+ * longest line if that is longer) whatever the size of the file. Supports the same records as
+ * load() except:
+ *  - Faces can only use vertices that come before them in the file.
+ *  - Faces with more than 3 sides are split into a fan, as the vertices needed to ear clip them
+ *    are not kept. Concave faces may come out wrong.
+ *  - Vertices are not welded.
+ */
+void stream(const std::string& filename, const StreamHandler& handler,
+            size_t chunk_size = kStreamChunkSize);
 
 }  // namespace rastrum::obj
 
@@ -0,0 +1,30 @@
+#ifndef RASTRUM_PLY_H
+#define RASTRUM_PLY_H
+
+#include <string>
+#include <string_view>
+
+#include "rastrum/Model.h"
+
+namespace rastrum::ply {
+
+/** Whether contents start with the magic line of a .ply file. */
+auto isPly(std::string_view contents) -> bool;
+
+/**
+ * Loads a binary .ply file, in either byte order, and returns the loaded model.
+ * Only the x, y and z properties of the vertex element and the vertex_indices (or vertex_index)
+ * list of the face element are used, any other properties and elements are skipped. Properties
+ * may have any of the PLY number types. Faces with more than 3 sides are split into triangles by
+ * ear clipping. Vertices with identical positions are welded together, as obj::load does.
+ * The file is memory mapped and read in place. Terminates if the file is ASCII PLY, is missing
+ * the vertex positions or is truncated.
+ * Fixed size elements are read by up to threads workers (0 uses all cores). The model stores its
+ * vertices with the specified layout.
+ */
+auto load(const std::string& filename, VertexLayout layout = VertexLayout::kAoS,
+          size_t threads = 0) -> Model;
+
+}  // namespace rastrum::ply
+
+#endif
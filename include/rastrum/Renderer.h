@@ -0,0 +1,175 @@
+#ifndef RASTRUM_RENDERER_H
+#define RASTRUM_RENDERER_H
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "rastrum/Bvh.h"
+#include "rastrum/CompressedModel.h"
+#include "rastrum/FrameBuffer.h"
+#include "rastrum/Geometry.h"
+#include "rastrum/Meshlet.h"
+#include "rastrum/Model.h"
+#include "rastrum/Vector.h"
+
+namespace rastrum {
+
+namespace parallel {
+class Pool;
+}  // namespace parallel
+
+/**
+ * A sort-middle renderer that draws into a BasicFrameBuffer of any pixel format using multiple
+ * threads, see Renderer for the usual RGBA8 buffer.
+ * Triangles are binned into fixed screen tiles as they are submitted. Calling flush() then
+ * rasterizes every tile in parallel on workers that are started once with the renderer, so
+ * drawing a frame doesn't start any threads. Each tile owns its own pixels so workers never share a
+ * pixel and no locking is needed. Triangles are drawn in submission order within a tile so
+ * overlapping triangles resolve the same way as drawing them directly with
+ * FrameBuffer::fillTriangle.
+ * Triangles pass through a GeometryStage before they are binned, so ones that can't produce
+ * any pixels are dropped before any raster work is done and ones that extend past the guard band
+ * or depth range are clipped.
+ */
+template <typename Format>
+class BasicRenderer {
+ public:
+  /** Maps a model space vertex to screen space. */
+  using VertexTransform = std::function<Vector3DF(const Vector3DF&)>;
+
+  /** Picks the color of a model's face, returning nothing skips drawing the face. */
+  using FaceShader = std::function<std::optional<RGBA>(size_t face_idx)>;
+
+  /** Width and height of a screen tile in pixels. */
+  static constexpr int kTileSize = 64;
+
+  /** Creates a renderer for buffer using up to threads workers (0 uses all cores). */
+  explicit BasicRenderer(BasicFrameBuffer<Format>& buffer, size_t threads = 0);
+
+  /** Stops the workers. */
+  ~BasicRenderer();
+
+  /** Queues a filled triangle, it will be drawn on the next flush() unless it is culled. */
+  void fillTriangle(Vector3DF a, Vector3DF b, Vector3DF c, RGBA value);
+
+  /**
+   * Queues every face of a model.
+   * Each vertex is transformed exactly once into a buffer that is reused between calls, then
+   * faces are assembled straight from the model's indices. The shader is only called for faces
+   * that survive culling.
+   */
+  void drawModel(const Model& model, const VertexTransform& transform, const FaceShader& shader);
+
+  /**
+   * Queues every face of a model transformed by a matrix, such as viewport * projection * view *
+   * model. Vertices are transformed in batches with SIMD. Faces that cross the near plane or reach
+   * behind the viewer are transformed again to be clipped before the divide by w.
+   */
+  void drawModel(const Model& model, const Matrix4F& transform, const FaceShader& shader);
+
+  /**
+   * Queues the faces of a model that may be visible, as above. Subtrees of the model's hierarchy
+   * that are off screen or outside the depth range are skipped without transforming or testing
+   * any of their faces, and only the vertices of the remaining faces are transformed. Faces are
+   * queued in the hierarchy's order unless all of them may be visible.
+   */
+  void drawModel(const Model& model, const Bvh& bvh, const Matrix4F& transform,
+                 const FaceShader& shader);
+
+  /**
+   * Queues the faces of a model one cluster at a time, see Meshlets. Clusters that are entirely
+   * off screen or facing away from the viewer are culled by the geometry stage as a whole, the
+   * vertices of the rest are transformed in a batch per cluster and their faces culled as usual.
+   * Faces are queued in cluster order.
+   */
+  void drawModel(const Model& model, const Meshlets& meshlets, const Matrix4F& transform,
+                 const FaceShader& shader);
+
+  /**
+   * Queues every face of a compressed model transformed by a matrix. Quantized vertices are
+   * converted to floats in batches and transformed by transform * model.dequantization() without
+   * ever being decompressed, and each block of indices is decoded just before its faces are
+   * queued.
+   */
+  void drawModel(const CompressedModel& model, const Matrix4F& transform,
+                 const FaceShader& shader);
+
+  /** Sets the range of depths that are drawn, see GeometryStage::setDepthRange. */
+  void setDepthRange(float min_z, float max_z);
+
+  /** Rasterizes all queued triangles into the buffer and empties the queue. */
+  void flush();
+
+  /** The number of workers used by flush(). */
+  auto threads() const -> size_t;
+
+  /** Gets the counts of triangles submitted and culled by the geometry stage. */
+  auto stats() const -> const CullStats&;
+
+ private:
+  /** A queued triangle. */
+  struct Triangle {
+    Vector3DF a;
+    Vector3DF b;
+    Vector3DF c;
+    RGBA value;
+  };
+
+  /**
+   * Queues the faces of a model whose vertices have been transformed into _transformed by
+   * transform, or by a VertexTransform straight to screen space if it's null.
+   */
+  void drawTransformed(const Model& model, const Matrix4F* transform, const FaceShader& shader);
+
+  /** Queues some of the faces of a model whose vertices have been transformed, as above. */
+  void drawTransformed(const Model& model, std::span<const uint32_t> faces,
+                       const Matrix4F* transform, const FaceShader& shader);
+
+  /**
+   * Queues a transformed face, shading it only if it survives culling. homogeneous() returns the
+   * face's vertices before the divide by w, it's only called if the face needs clipping to the
+   * depth range, see GeometryStage::process.
+   */
+  template <typename H>
+  void drawFace(Vector3DF a, Vector3DF b, Vector3DF c, size_t face_idx, const FaceShader& shader,
+                H&& homogeneous);
+
+  /** Adds a triangle to the bins of every tile it may cover. */
+  void bin(Vector3DF a, Vector3DF b, Vector3DF c, RGBA value);
+
+  BasicFrameBuffer<Format>& _buffer;
+  /** Rasterizes tiles in flush(). */
+  std::unique_ptr<parallel::Pool> _pool;
+  GeometryStage _geometry;
+  int _tiles_x;
+  int _tiles_y;
+  std::vector<Triangle> _triangles;
+  /** Screen space vertices of the last model drawn. */
+  std::vector<Vector3DF> _transformed;
+  /** The faces of the last model drawn with a hierarchy that may be visible. */
+  std::vector<uint32_t> _visible_faces;
+  /** The vertices those faces use, and their positions gathered to be transformed together. */
+  std::vector<uint32_t> _visible_vertices;
+  std::vector<Vector3DF> _gathered;
+  std::vector<bool> _vertex_visible;
+  /** A batch of a compressed model's quantized vertices as an aligned array of each coordinate. */
+  AlignedFloats _decoded;
+  /** Indices into _triangles for each tile, tiles are stored left to right, top to bottom. */
+  std::vector<std::vector<uint32_t>> _bins;
+};
+
+extern template class BasicRenderer<RGBA8>;
+extern template class BasicRenderer<BGRA8>;
+extern template class BasicRenderer<RGB565>;
+extern template class BasicRenderer<RGBA32F>;
+
+/** A renderer drawing into a FrameBuffer of 8 bit RGBA pixels. */
+using Renderer = BasicRenderer<RGBA8>;
+
+}  // namespace rastrum
+
+#endif
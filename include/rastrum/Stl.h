@@ -0,0 +1,29 @@
+#ifndef RASTRUM_STL_H
+#define RASTRUM_STL_H
+
+#include <string>
+#include <string_view>
+
+#include "rastrum/Model.h"
+
+namespace rastrum::stl {
+
+/**
+ * Whether contents look like a binary .stl file: an 80 byte header, a triangle count and exactly
+ * that many 50 byte triangles.
+ */
+auto isBinary(std::string_view contents) -> bool;
+
+/**
+ * Loads a binary .stl file and returns the loaded model, terminates if it isn't one.
+ * STL stores every triangle with its own three vertices, so vertices with identical positions are
+ * welded together to give an indexed model. Normals and attribute bytes are ignored.
+ * The file is memory mapped and its triangles read in place by up to threads workers (0 uses all
+ * cores). The model stores its vertices with the specified layout.
+ */
+auto load(const std::string& filename, VertexLayout layout = VertexLayout::kAoS,
+          size_t threads = 0) -> Model;
+
+}  // namespace rastrum::stl
+
+#endif
@@ -1,9 +1,13 @@
 #ifndef RASTRUM_VECTOR_H
 #define RASTRUM_VECTOR_H
 
+#include <algorithm>
 #include <array>
 #include <cmath>
+#include <cstddef>
+#include <limits>
 #include <ostream>
+#include <type_traits>
 
 namespace rastrum {
 
@@ -230,6 +234,18 @@ auto max(const Vector<T, D>& lhs, const Vector<T, D>& rhs) -> Vector<T, D> {
   return res;
 }
 
+/** Vector addition. */
+template <typename T, size_t D>
+auto operator+(const Vector<T, D>& lhs, const Vector<T, D>& rhs) -> Vector<T, D> {
+  Vector<T, D> res = lhs;
+
+  for (size_t idx = 0; idx < D; ++idx) {
+    res[idx] += rhs[idx];
+  }
+
+  return res;
+}
+
 /** Vector subtraction. */
 template <typename T, size_t D>
 auto operator-(const Vector<T, D>& lhs, const Vector<T, D>& rhs) -> Vector<T, D> {
@@ -273,5 +289,272 @@ typedef Vector<int, 2> Pixel;
 /** An 3D vector using floats. */
 typedef Vector<float, 3> Vector3DF;
 
+/** An 4D vector using floats. */
+typedef Vector<float, 4> Vector4DF;
+
+/**
+ * An n x n math matrix class, stored row-major.
+ * Vectors are treated as columns, so transforms compose right to left: (a * b) * v == a * (b * v).
+ */
+template <typename T, size_t N>
+class Matrix {
+ public:
+  using type = T;
+
+  Matrix() = default;
+  Matrix(std::array<std::array<T, N>, N> rows) : _rows(rows) {
+  }
+
+  /** Create an identity matrix. */
+  static auto identity() -> Matrix<T, N> {
+    Matrix<T, N> res;
+
+    for (size_t row = 0; row < N; ++row) {
+      for (size_t col = 0; col < N; ++col) {
+        res(row, col) = row == col ? 1 : 0;
+      }
+    }
+
+    return res;
+  }
+
+  // Element accessors
+
+  auto operator()(size_t row, size_t col) -> T& {
+    return _rows[row][col];
+  }
+
+  auto operator()(size_t row, size_t col) const -> T {
+    return _rows[row][col];
+  }
+
+  /** Transforms a point, treating it as having w = 1 and dividing the result by its w. */
+  auto transformPoint(const Vector<T, 3>& point) const -> Vector<T, 3>
+    requires(N == 4)
+  {
+    const auto res = (*this) * Vector<T, 4>{{point.x(), point.y(), point.z(), 1}};
+    return Vector<T, 3>{{res.x() / res.w(), res.y() / res.w(), res.z() / res.w()}};
+  }
+
+  /** Transforms a direction, treating it as having w = 0. */
+  auto transformDirection(const Vector<T, 3>& direction) const -> Vector<T, 3>
+    requires(N == 4)
+  {
+    return ((*this) * Vector<T, 4>{{direction.x(), direction.y(), direction.z(), 0}})
+        .template resize<3>();
+  }
+
+ private:
+  std::array<std::array<T, N>, N> _rows;
+};
+
+/** Matrix multiplication. */
+template <typename T, size_t N>
+auto operator*(const Matrix<T, N>& lhs, const Matrix<T, N>& rhs) -> Matrix<T, N> {
+  Matrix<T, N> res;
+
+  for (size_t row = 0; row < N; ++row) {
+    for (size_t col = 0; col < N; ++col) {
+      T sum = 0;
+
+      for (size_t idx = 0; idx < N; ++idx) {
+        sum += lhs(row, idx) * rhs(idx, col);
+      }
+
+      res(row, col) = sum;
+    }
+  }
+
+  return res;
+}
+
+/** Matrix-vector multiplication. */
+template <typename T, size_t N>
+auto operator*(const Matrix<T, N>& lhs, const Vector<T, N>& rhs) -> Vector<T, N> {
+  Vector<T, N> res;
+
+  for (size_t row = 0; row < N; ++row) {
+    T sum = 0;
+
+    for (size_t col = 0; col < N; ++col) {
+      sum += lhs(row, col) * rhs[col];
+    }
+
+    res[row] = sum;
+  }
+
+  return res;
+}
+
+/** Pretty prints a matrix to a stream. */
+template <typename T, size_t N>
+auto operator<<(std::ostream& out, const Matrix<T, N>& mat) -> std::ostream& {
+  out << "Mat<" << N << ">(";
+
+  for (size_t row = 0; row < N; ++row) {
+    for (size_t col = 0; col < N; ++col) {
+      out << mat(row, col);
+
+      if (col != N - 1) {
+        out << ",";
+      }
+    }
+
+    if (row != N - 1) {
+      out << ";";
+    }
+  }
+
+  out << ")";
+
+  return out;
+}
+
+/** A 4x4 matrix using floats. */
+typedef Matrix<float, 4> Matrix4F;
+
+// Model, view and projection helpers. These follow the OpenGL conventions: view space looks down
+// -Z and projections map the view volume to [-1, 1] on every axis with the near plane at Z = -1.
+
+/** Creates a model matrix that moves points by an offset. */
+template <typename T>
+auto translation(const Vector<T, 3>& offset) -> Matrix<T, 4> {
+  auto res = Matrix<T, 4>::identity();
+  res(0, 3) = offset.x();
+  res(1, 3) = offset.y();
+  res(2, 3) = offset.z();
+  return res;
+}
+
+/** Creates a model matrix that scales each axis by a factor. */
+template <typename T>
+auto scaling(const Vector<T, 3>& factors) -> Matrix<T, 4> {
+  auto res = Matrix<T, 4>::identity();
+  res(0, 0) = factors.x();
+  res(1, 1) = factors.y();
+  res(2, 2) = factors.z();
+  return res;
+}
+
+/** Creates a model matrix that rotates around the X axis by an angle in radians. */
+template <typename T>
+auto rotationX(T angle) -> Matrix<T, 4> {
+  auto res = Matrix<T, 4>::identity();
+  res(1, 1) = std::cos(angle);
+  res(1, 2) = -std::sin(angle);
+  res(2, 1) = std::sin(angle);
+  res(2, 2) = std::cos(angle);
+  return res;
+}
+
+/** Creates a model matrix that rotates around the Y axis by an angle in radians. */
+template <typename T>
+auto rotationY(T angle) -> Matrix<T, 4> {
+  auto res = Matrix<T, 4>::identity();
+  res(0, 0) = std::cos(angle);
+  res(0, 2) = std::sin(angle);
+  res(2, 0) = -std::sin(angle);
+  res(2, 2) = std::cos(angle);
+  return res;
+}
+
+/** Creates a model matrix that rotates around the Z axis by an angle in radians. */
+template <typename T>
+auto rotationZ(T angle) -> Matrix<T, 4> {
+  auto res = Matrix<T, 4>::identity();
+  res(0, 0) = std::cos(angle);
+  res(0, 1) = -std::sin(angle);
+  res(1, 0) = std::sin(angle);
+  res(1, 1) = std::cos(angle);
+  return res;
+}
+
+/** Creates a view matrix for a camera at eye looking towards target. */
+template <typename T>
+auto lookAt(const Vector<T, 3>& eye, const Vector<T, 3>& target, const Vector<T, 3>& up)
+    -> Matrix<T, 4> {
+  const auto forward = (target - eye).normalize();
+  const auto right = forward.cross(up).normalize();
+  const auto cam_up = right.cross(forward);
+
+  auto res = Matrix<T, 4>::identity();
+  for (size_t col = 0; col < 3; ++col) {
+    res(0, col) = right[col];
+    res(1, col) = cam_up[col];
+    res(2, col) = -forward[col];
+  }
+  res(0, 3) = -right.dot(eye);
+  res(1, 3) = -cam_up.dot(eye);
+  res(2, 3) = forward.dot(eye);
+  return res;
+}
+
+/** Creates an orthographic projection of the view space box between the specified planes. */
+template <typename T>
+auto orthographic(T left, T right, T bottom, T top, T near_z, T far_z) -> Matrix<T, 4> {
+  auto res = Matrix<T, 4>::identity();
+  res(0, 0) = 2 / (right - left);
+  res(1, 1) = 2 / (top - bottom);
+  res(2, 2) = -2 / (far_z - near_z);
+  res(0, 3) = -(right + left) / (right - left);
+  res(1, 3) = -(top + bottom) / (top - bottom);
+  res(2, 3) = -(far_z + near_z) / (far_z - near_z);
+  return res;
+}
+
+/**
+ * Creates a perspective projection with a vertical field of view in radians and an aspect ratio
+ * of width / height. near_z and far_z are the positive distances to the near and far planes.
+ */
+template <typename T>
+auto perspective(T fov_y, T aspect, T near_z, T far_z) -> Matrix<T, 4> {
+  const T focal = 1 / std::tan(fov_y / 2);
+
+  Matrix<T, 4> res{};
+  res(0, 0) = focal / aspect;
+  res(1, 1) = focal;
+  res(2, 2) = (far_z + near_z) / (near_z - far_z);
+  res(2, 3) = (2 * far_z * near_z) / (near_z - far_z);
+  res(3, 2) = -1;
+  return res;
+}
+
+/**
+ * Creates a matrix mapping projected points to a width x height FrameBuffer.
+ * X and Y map from [-1, 1] to [0, width - 1] and [height - 1, 0], so up is towards the top of the
+ * buffer. Z is negated, so the near plane maps to 1 and the far plane to -1 as larger depths win
+ * the depth test.
+ */
+template <typename T>
+auto viewport(size_t width, size_t height) -> Matrix<T, 4> {
+  const T half_width = static_cast<T>(width - 1) / 2;
+  const T half_height = static_cast<T>(height - 1) / 2;
+
+  auto res = Matrix<T, 4>::identity();
+  res(0, 0) = half_width;
+  res(0, 3) = half_width;
+  res(1, 1) = -half_height;
+  res(1, 3) = half_height;
+  res(2, 2) = -1;
+  return res;
+}
+
+/**
+ * Transforms count points by a matrix, treating them as having w = 1 and dividing the results by
+ * their w. Points are processed several at a time with SIMD where available. Points that end up
+ * behind the viewer (w <= 0) can't be projected and are set to NaN, faces using them are clipped
+ * before the divide instead, see GeometryStage::process. out may be points to transform them in
+ * place.
+ */
+void transformPoints(const Matrix4F& matrix, const Vector3DF* points, Vector3DF* out,
+                     size_t count);
+
+/**
+ * Transforms count points given as separate arrays of each coordinate, see above. Avoids
+ * shuffling the points into SIMD registers, the arrays must be 16 byte aligned.
+ */
+void transformPoints(const Matrix4F& matrix, const float* xs, const float* ys, const float* zs,
+                     Vector3DF* out, size_t count);
+
 }  // namespace rastrum
 #endif
\ No newline at end of file
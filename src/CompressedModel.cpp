@@ -0,0 +1,158 @@
+#include "rastrum/CompressedModel.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include "simd.h"
+
+namespace {
+/** Maps a signed difference to an unsigned one so small negative values stay small. */
+auto zigzag(int64_t value) -> uint64_t {
+  return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+/** Appends value to out seven bits at a time, least significant first. */
+void writeVarint(uint64_t value, std::vector<uint8_t>& out) {
+  while (value >= 0x80) {
+    out.push_back(static_cast<uint8_t>(value | 0x80));
+    value >>= 7;
+  }
+  out.push_back(static_cast<uint8_t>(value));
+}
+
+/** Quantizes one coordinate of every vertex across [min, min + extent]. */
+auto quantize(std::span<const rastrum::Vector3DF> vertices, size_t axis, float min, float extent)
+    -> std::vector<uint16_t> {
+  const float scale = extent > 0 ? rastrum::CompressedModel::kMaxQuantized / extent : 0;
+  std::vector<uint16_t> res(vertices.size());
+  for (size_t idx = 0; idx < vertices.size(); ++idx) {
+    res[idx] = static_cast<uint16_t>(std::lround((vertices[idx][axis] - min) * scale));
+  }
+  return res;
+}
+}  // namespace
+
+rastrum::CompressedModel::CompressedModel(const Model& model)
+    : _face_count(model.face_count()), _dequantization(Matrix4F::identity()) {
+  const auto vertices = model.vertices();
+  if (!vertices.empty()) {
+    auto min = vertices.front();
+    auto max = min;
+    for (const auto& vert : vertices) {
+      min = rastrum::min(min, vert);
+      max = rastrum::max(max, vert);
+    }
+
+    const auto extent = max - min;
+    _xs = quantize(vertices, 0, min.x(), extent.x());
+    _ys = quantize(vertices, 1, min.y(), extent.y());
+    _zs = quantize(vertices, 2, min.z(), extent.z());
+    _dequantization = translation(min) * scaling(Vector3DF{{extent.x() / kMaxQuantized,
+                                                            extent.y() / kMaxQuantized,
+                                                            extent.z() / kMaxQuantized}});
+  }
+
+  // Indices of a mesh ordered for the vertex cache are close to the ones before them, so the
+  // differences are small and most fit in a byte
+  _block_offsets.reserve(block_count() + 1);
+  model.vert_indices().visit([&](auto indices) {
+    for (size_t first = 0; first < indices.size(); first += kBlockFaces * kModelFaceSize) {
+      _block_offsets.push_back(_indices.size());
+      const auto last = std::min(indices.size(), first + (kBlockFaces * kModelFaceSize));
+      int64_t prev = 0;
+      for (size_t idx = first; idx < last; ++idx) {
+        const auto vert_idx = static_cast<int64_t>(indices[idx]);
+        writeVarint(zigzag(vert_idx - prev), _indices);
+        prev = vert_idx;
+      }
+    }
+  });
+  _block_offsets.push_back(_indices.size());
+  _indices.shrink_to_fit();
+}
+
+auto rastrum::CompressedModel::vertex_count() const -> size_t {
+  return _xs.size();
+}
+
+auto rastrum::CompressedModel::face_count() const -> size_t {
+  return _face_count;
+}
+
+auto rastrum::CompressedModel::block_count() const -> size_t {
+  return (_face_count + kBlockFaces - 1) / kBlockFaces;
+}
+
+auto rastrum::CompressedModel::dequantization() const -> const Matrix4F& {
+  return _dequantization;
+}
+
+void rastrum::CompressedModel::decodeVertices(size_t first, size_t count, float* xs, float* ys,
+                                              float* zs) const {
+  size_t idx = 0;
+
+#if defined(__SSE2__)
+  for (; idx + simd::kShortWidth <= count; idx += simd::kShortWidth) {
+    simd::toFloat(&_xs[first + idx], xs + idx);
+    simd::toFloat(&_ys[first + idx], ys + idx);
+    simd::toFloat(&_zs[first + idx], zs + idx);
+  }
+#endif
+
+  for (; idx < count; ++idx) {
+    xs[idx] = _xs[first + idx];
+    ys[idx] = _ys[first + idx];
+    zs[idx] = _zs[first + idx];
+  }
+}
+
+auto rastrum::CompressedModel::decodeIndices(size_t block, uint32_t* out) const -> size_t {
+  assert(block < block_count());
+  const uint8_t* data = _indices.data() + _block_offsets[block];
+  const uint8_t* const end = _indices.data() + _block_offsets[block + 1];
+  size_t count = 0;
+  int64_t prev = 0;
+
+  while (data < end) {
+    uint64_t value = *data++;
+    // Most differences fit in one byte, only loop for longer ones
+    if (value >= 0x80) {
+      value &= 0x7F;
+      int shift = 7;
+      uint8_t byte = 0;
+      do {
+        byte = *data++;
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        shift += 7;
+      } while (byte >= 0x80);
+    }
+
+    prev += static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+    out[count++] = static_cast<uint32_t>(prev);
+  }
+
+  return count;
+}
+
+auto rastrum::CompressedModel::decompress(VertexLayout layout) const -> Model {
+  std::vector<Vector3DF> vertices(vertex_count());
+  for (size_t idx = 0; idx < vertices.size(); ++idx) {
+    const Vector3DF quantized{
+        {static_cast<float>(_xs[idx]), static_cast<float>(_ys[idx]), static_cast<float>(_zs[idx])}};
+    vertices[idx] = _dequantization.transformPoint(quantized);
+  }
+
+  std::vector<uint32_t> indices(_face_count * kModelFaceSize);
+  size_t count = 0;
+  for (size_t block = 0; block < block_count(); ++block) {
+    count += decodeIndices(block, &indices[count]);
+  }
+
+  return {std::move(vertices), IndexBuffer(std::move(indices), vertex_count()), layout};
+}
+
+auto rastrum::CompressedModel::memory_size() const -> size_t {
+  return ((_xs.size() + _ys.size() + _zs.size()) * sizeof(uint16_t)) + _indices.size() +
+         (_block_offsets.size() * sizeof(size_t));
+}
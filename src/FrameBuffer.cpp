@@ -1,55 +1,256 @@
 #include "rastrum/FrameBuffer.h"
 
+#include <algorithm>
+#include <array>
 #include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <type_traits>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "binary.h"
+#include "rastrum/Geometry.h"
 #include "stb/stb_image_write.h"
 #include "terminal.h"
 
-rastrum::FrameBuffer::FrameBuffer(size_t width, size_t height)
-    : _width(width), _height(height), _data(width * height), _z_buffer(width * height) {
-  std::fill(_z_buffer.begin(), _z_buffer.end(), std::numeric_limits<float>::lowest());
+namespace {
+/** Divides rounding towards negative infinity. */
+auto floorDiv(int64_t num, int64_t den) -> int64_t {
+  const auto quot = num / den;
+  return (num % den != 0 && (num < 0) != (den < 0)) ? quot - 1 : quot;
+}
+
+/** Divides rounding towards positive infinity. */
+auto ceilDiv(int64_t num, int64_t den) -> int64_t {
+  return -floorDiv(-num, den);
+}
+
+/** Returns the first multiple of tile_size that is greater than a non-negative pos. */
+auto nextTile(int pos, int tile_size) -> int {
+  return ((pos / tile_size) + 1) * tile_size;
+}
+
+/** Copies Count pixels, with whole SIMD registers when they fill them. */
+template <size_t Count, typename Storage>
+void copyRow(const Storage* src, Storage* dst) {
+  constexpr size_t kBytes = Count * sizeof(Storage);
+
+#if defined(__SSE2__)
+  if constexpr (kBytes % sizeof(__m128i) == 0) {
+    const auto* in = reinterpret_cast<const __m128i*>(src);
+    auto* out = reinterpret_cast<__m128i*>(dst);
+    for (size_t idx = 0; idx < kBytes / sizeof(__m128i); ++idx) {
+      _mm_storeu_si128(out + idx, _mm_loadu_si128(in + idx));
+    }
+    return;
+  }
+#endif
+
+  std::memcpy(dst, src, kBytes);
+}
+
+/**
+ * Writes width x height BGRA pixels, indexed left to right, top to bottom, as a 32 bit BMP. That
+ * is the byte order BMP stores, so rows are written straight from pixels. The headers are the same
+ * as stb writes for RGBA. Returns false if the file couldn't be written.
+ */
+auto writeBgraBmp(const std::string& filename, size_t width, size_t height,
+                  const rastrum::BGRA* pixels) -> bool {
+  // A BITMAPV4HEADER is needed for readers to use the alpha channel
+  constexpr uint32_t kFileHeaderSize = 14;
+  constexpr uint32_t kInfoHeaderSize = 108;
+  constexpr uint32_t kBitFields = 3;
+  const auto row_bytes = width * sizeof(rastrum::BGRA);
+
+  std::array<char, kFileHeaderSize + kInfoHeaderSize> header{'B', 'M'};
+  size_t offset = 2;
+  const auto put = [&](auto value) {
+    rastrum::binary::write(header.data() + offset, value);
+    offset += sizeof(value);
+  };
+
+  put(static_cast<uint32_t>(header.size() + (row_bytes * height)));
+  put(uint32_t{0});
+  put(static_cast<uint32_t>(header.size()));
+  put(kInfoHeaderSize);
+  put(static_cast<int32_t>(width));
+  put(static_cast<int32_t>(height));
+  put(uint16_t{1});
+  put(uint16_t{32});
+  put(kBitFields);
+  // The image size, resolution and palette are left zero
+  offset += 5 * sizeof(uint32_t);
+  for (const uint32_t mask : {0x00FF0000U, 0x0000FF00U, 0x000000FFU, 0xFF000000U}) {
+    put(mask);
+  }
+  // As are the color space and gamma
+
+  std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+  file.write(header.data(), header.size());
+  // Rows are stored bottom up
+  for (size_t y = height; y-- > 0;) {
+    file.write(reinterpret_cast<const char*>(pixels + (y * width)),
+               static_cast<std::streamsize>(row_bytes));
+  }
+
+  return file.good();
+}
+
+#if defined(__SSE2__)
+/** Picks the lanes of a that are set in mask and the lanes of b that aren't. */
+auto select(__m128i mask, __m128i a, __m128i b) -> __m128i {
+  return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+/** Writes a triangle's color to spans of 4 pixels, blending in registers where pixels fit. */
+template <typename Storage>
+class SpanWriter {
+ public:
+  explicit SpanWriter(const Storage& value) : _value(value) {
+    if constexpr (sizeof(Storage) == sizeof(uint32_t)) {
+      uint32_t packed = 0;
+      std::memcpy(&packed, &value, sizeof(packed));
+      _span_value = _mm_set1_epi32(static_cast<int>(packed));
+    } else if constexpr (sizeof(Storage) == sizeof(uint16_t)) {
+      uint16_t packed = 0;
+      std::memcpy(&packed, &value, sizeof(packed));
+      _span_value = _mm_set1_epi16(static_cast<int16_t>(packed));
+    }
+  }
+
+  /** Sets the pixels starting at data whose 32 bit lanes are set in pass. */
+  void write(Storage* data, __m128i pass) const {
+    if constexpr (sizeof(Storage) == sizeof(uint32_t)) {
+      auto* ptr = reinterpret_cast<__m128i*>(data);
+      _mm_storeu_si128(ptr, select(pass, _span_value, _mm_loadu_si128(ptr)));
+    } else if constexpr (sizeof(Storage) == sizeof(uint16_t)) {
+      // Narrow the mask to 16 bit lanes, the span fits in the low half of a register
+      auto* ptr = reinterpret_cast<__m128i*>(data);
+      _mm_storel_epi64(ptr, select(_mm_packs_epi32(pass, pass), _span_value, _mm_loadl_epi64(ptr)));
+    } else {
+      // Wider pixels are each stored whole
+      const int lanes = _mm_movemask_ps(_mm_castsi128_ps(pass));
+      for (int lane = 0; lane < 4; ++lane) {
+        if ((lanes & (1 << lane)) != 0) {
+          data[lane] = _value;
+        }
+      }
+    }
+  }
+
+ private:
+  Storage _value;
+  __m128i _span_value = _mm_setzero_si128();
+};
+#endif
+}  // namespace
+
+template <typename Format>
+rastrum::BasicFrameBuffer<Format>::BasicFrameBuffer(size_t width, size_t height,
+                                                    PixelLayout layout)
+    : _width(width),
+      _height(height),
+      _layout(layout),
+      _layout_tiles_x((width + kLayoutTileSize - 1) / kLayoutTileSize),
+      _depth_tiles_x((width + kDepthTileSize - 1) / kDepthTileSize),
+      _depth_tiles_y((height + kDepthTileSize - 1) / kDepthTileSize),
+      _coarse_tiles_x((_depth_tiles_x + kDepthTileFan - 1) / kDepthTileFan),
+      _coarse_tiles_y((_depth_tiles_y + kDepthTileFan - 1) / kDepthTileFan) {
+  // Tiled buffers are padded out to whole tiles, the padding is never drawn
+  const auto layout_tiles_y = (height + kLayoutTileSize - 1) / kLayoutTileSize;
+  const auto size = layout == PixelLayout::kTiled
+                        ? _layout_tiles_x * layout_tiles_y * kLayoutTileSize * kLayoutTileSize
+                        : width * height;
+  _data.resize(size);
+  _z_buffer.resize(size);
+
+  constexpr auto kFar = std::numeric_limits<float>::lowest();
+  std::fill(_z_buffer.begin(), _z_buffer.end(), kFar);
+  _depth_tiles.resize(_depth_tiles_x * _depth_tiles_y, kFar);
+  _coarse_tiles.resize(_coarse_tiles_x * _coarse_tiles_y, kFar);
+  _coarse_dirty.resize(_coarse_tiles.size(), 0);
 }
 
-auto rastrum::FrameBuffer::width() const -> size_t {
+template <typename Format>
+auto rastrum::BasicFrameBuffer<Format>::width() const -> size_t {
   return _width;
 }
 
-auto rastrum::FrameBuffer::height() const -> size_t {
+template <typename Format>
+auto rastrum::BasicFrameBuffer<Format>::height() const -> size_t {
   return _height;
 }
 
-auto rastrum::FrameBuffer::data() const -> const rastrum::RGBA* {
+template <typename Format>
+auto rastrum::BasicFrameBuffer<Format>::layout() const -> PixelLayout {
+  return _layout;
+}
+
+template <typename Format>
+auto rastrum::BasicFrameBuffer<Format>::data() const -> const Storage* {
   return _data.data();
 }
 
-void rastrum::FrameBuffer::set(size_t idx, RGBA value, float z) {
-  if (idx >= _data.size()) {
-    std::cerr << "Attempted to access outside of framebuffer bounds: " << idx << "\n";
-    exit(1);
+template <typename Format>
+auto rastrum::BasicFrameBuffer<Format>::linearData() const -> std::vector<Storage> {
+  if (_layout == PixelLayout::kLinear) {
+    return _data;
   }
 
-  if (z >= _z_buffer[idx]) {
-    _data[idx] = value;
-    _z_buffer[idx] = z;
+  // Copy each row of each tile whole, a tile row is a run of pixels in the linear order too
+  std::vector<Storage> linear(_width * _height);
+  for (size_t y = 0; y < _height; ++y) {
+    const Storage* src = &_data[index(0, y)];
+    Storage* dst = &linear[y * _width];
+    size_t x = 0;
+
+    for (; x + kLayoutTileSize <= _width; x += kLayoutTileSize) {
+      copyRow<kLayoutTileSize>(src, dst + x);
+      src += kLayoutTileSize * kLayoutTileSize;
+    }
+    std::copy(src, src + (_width - x), dst + x);
+  }
+
+  return linear;
+}
+
+template <typename Format>
+auto rastrum::BasicFrameBuffer<Format>::color(size_t idx) const -> RGBA {
+  return Format::unpack(_data[index(idx % _width, idx / _width)]);
+}
+
+template <typename Format>
+void rastrum::BasicFrameBuffer<Format>::set(size_t idx, RGBA value, float z) {
+  if (idx >= _width * _height) {
+    // Clipped
+    return;
   }
+
+  set(Pixel{{static_cast<int>(idx % _width), static_cast<int>(idx / _width)}}, value, z);
 }
 
-void rastrum::FrameBuffer::set(Pixel point, RGBA value, float z) {
-  const auto idx = (point.y() * _width) + point.x();
-  if (idx >= _data.size()) {
-    std::cerr << "Attempted to access outside of framebuffer bounds: " << idx << "," << point
-              << "\n";
-    exit(1);
+template <typename Format>
+void rastrum::BasicFrameBuffer<Format>::set(Pixel point, RGBA value, float z) {
+  if (point.x() < 0 || point.y() < 0 || point.x() >= static_cast<int>(_width) ||
+      point.y() >= static_cast<int>(_height)) {
+    // Clipped
+    return;
   }
 
+  const auto idx = index(point.x(), point.y());
   if (z >= _z_buffer[idx]) {
-    _data[idx] = value;
+    _data[idx] = Format::pack(value);
     _z_buffer[idx] = z;
   }
 }
 
-void rastrum::FrameBuffer::line(Vector3DF start, Vector3DF end, RGBA value) {
+template <typename Format>
+void rastrum::BasicFrameBuffer<Format>::line(Vector3DF start, Vector3DF end, RGBA value) {
   // Uses https://en.wikipedia.org/wiki/Bresenham%27s_line_algorithm
 
   if (std::abs(end.y() - start.y()) < std::abs(end.x() - start.x())) {
@@ -67,56 +268,365 @@ void rastrum::FrameBuffer::line(Vector3DF start, Vector3DF end, RGBA value) {
   }
 }
 
-void rastrum::FrameBuffer::triangle(Vector3DF a, Vector3DF b, Vector3DF c, RGBA value) {
+template <typename Format>
+void rastrum::BasicFrameBuffer<Format>::triangle(Vector3DF a, Vector3DF b, Vector3DF c,
+                                                 RGBA value) {
   line(a, b, value);
   line(b, c, value);
   line(c, a, value);
 }
 
-void rastrum::FrameBuffer::fillTriangle(Vector3DF a, Vector3DF b, Vector3DF c, RGBA value) {
-  // Calculate the bounding box so we don't have to test every pixel
-  const Pixel min = rastrum::min(rastrum::min(a, b), c).floor().as<int>().resize<2>();
-  const Pixel max = rastrum::max(rastrum::max(a, b), c).ceil().as<int>().resize<2>();
+template <typename Format>
+void rastrum::BasicFrameBuffer<Format>::fillTriangle(Vector3DF a, Vector3DF b, Vector3DF c,
+                                                     RGBA value) {
+  const Pixel clip_min{{0, 0}};
+  const Pixel clip_max{{static_cast<int>(_width), static_cast<int>(_height)}};
+
+  // Clip triangles that extend past the guard band, anything within it is clipped per pixel
+  const ClipBounds guard_band{
+      Vector3DF{{-kGuardBand, -kGuardBand, std::numeric_limits<float>::lowest()}},
+      Vector3DF{{static_cast<float>(_width) + kGuardBand, static_cast<float>(_height) + kGuardBand,
+                 std::numeric_limits<float>::max()}}};
+
+  if (guard_band.contains(a) && guard_band.contains(b) && guard_band.contains(c)) {
+    fillTriangle(a, b, c, value, clip_min, clip_max);
+    return;
+  }
+
+  const auto polygon = clip(a, b, c, guard_band);
+  for (size_t idx = 2; idx < polygon.count; ++idx) {
+    fillTriangle(polygon.verts[0], polygon.verts[idx - 1], polygon.verts[idx], value, clip_min,
+                 clip_max);
+  }
+}
+
+template <typename Format>
+void rastrum::BasicFrameBuffer<Format>::fillTriangle(Vector3DF a, Vector3DF b, Vector3DF c,
+                                                     RGBA value, Pixel clip_min, Pixel clip_max) {
+  // Snap the vertices to the sub-pixel grid. Vertices too far out to be snapped without
+  // overflowing the edge equations should have been clipped to the guard band, if not the
+  // triangle is dropped.
+  std::array<std::array<int64_t, 2>, 3> fixed{};
+  const std::array<Vector3DF, 3> verts{a, b, c};
+  for (size_t vert = 0; vert < verts.size(); ++vert) {
+    for (size_t axis = 0; axis < 2; ++axis) {
+      if (!(std::abs(verts[vert][axis]) < kMaxCoord)) {
+        return;
+      }
+
+      fixed[vert][axis] = std::llround(verts[vert][axis] * kSubPixelScale);
+    }
+  }
+
+  // Calculate the bounding box of the pixels whose samples could be covered, clamped to the
+  // buffer so nothing past here needs to check bounds
+  const auto [min_x, max_x] = std::minmax({fixed[0][0], fixed[1][0], fixed[2][0]});
+  const auto [min_y, max_y] = std::minmax({fixed[0][1], fixed[1][1], fixed[2][1]});
+  const Pixel min{{std::max({static_cast<int>(ceilDiv(min_x, kSubPixelScale)), clip_min.x(), 0}),
+                   std::max({static_cast<int>(ceilDiv(min_y, kSubPixelScale)), clip_min.y(), 0})}};
+  const Pixel max{
+      {std::min({static_cast<int>(floorDiv(max_x, kSubPixelScale)) + 1, clip_max.x(),
+                 static_cast<int>(_width)}),
+       std::min({static_cast<int>(floorDiv(max_y, kSubPixelScale)) + 1, clip_max.y(),
+                 static_cast<int>(_height)})}};
+
+  if (min.x() >= max.x() || min.y() >= max.y()) {
+    return;
+  }
+
+  // The three edge values at any point sum to the area, so degenerate triangles and those wound
+  // the other way can never be inside all three edges
+  const int64_t area = ((fixed[2][0] - fixed[0][0]) * (fixed[1][1] - fixed[0][1])) -
+                       ((fixed[2][1] - fixed[0][1]) * (fixed[1][0] - fixed[0][0]));
+  if (area <= 0) {
+    return;
+  }
+
+  TriangleSetup tri;
+  tri.value = Format::pack(value);
+  tri.min_z = std::min({a.z(), b.z(), c.z()});
+  tri.max_z = std::max({a.z(), b.z(), c.z()});
+
+  for (size_t edge_idx = 0; edge_idx < tri.edges.size(); ++edge_idx) {
+    const auto& start = fixed[edge_idx];
+    const auto& end = fixed[(edge_idx + 1) % fixed.size()];
+
+    // In sub-pixel units the edge function is E(X, Y) = X * dx + Y * dy - k
+    const int64_t dx = end[1] - start[1];
+    const int64_t dy = start[0] - end[0];
+    const int64_t k = (start[0] * dx) + (start[1] * dy);
+
+    // Top-left rule: samples exactly on an edge belong to the triangle only if it is a left edge
+    // or a horizontal top edge, so samples on a shared edge are drawn by exactly one triangle.
+    const bool top_left = dx > 0 || (dx == 0 && dy > 0);
+    const int64_t bias = top_left ? 1 : 0;
+
+    // Samples sit on whole pixels, so E + bias > 0 reduces to x * dx + y * dy + offset >= 0
+    // which can be stepped with integer adds one pixel at a time.
+    tri.edges[edge_idx] = {dx, dy, -floorDiv(k - bias, kSubPixelScale) - 1};
+  }
+
+  // Depth is interpolated with the barycentric weights, which are each an opposite edge over
+  // the area. It is linear in x and y, so evaluate it relative to a pixel near the triangle to
+  // keep it precise.
+  tri.origin = Pixel{{min.x(), min.y()}};
+  const double inv_area = 1.0 / static_cast<double>(area);
+  const std::array<double, 3> z{a.z(), b.z(), c.z()};
+  double z_dx = 0;
+  double z_dy = 0;
+  double z_origin = 0;
+
+  for (size_t vert = 0; vert < z.size(); ++vert) {
+    // The edge opposite a vertex is the one that starts at the next vertex
+    const auto& opposite = tri.edges[(vert + 1) % z.size()];
+    const auto& start = fixed[(vert + 1) % z.size()];
+    const int64_t weight = ((tri.origin.x() * kSubPixelScale) - start[0]) * opposite.dx +
+                           ((tri.origin.y() * kSubPixelScale) - start[1]) * opposite.dy;
+
+    z_dx += z[vert] * static_cast<double>(opposite.dx);
+    z_dy += z[vert] * static_cast<double>(opposite.dy);
+    z_origin += z[vert] * static_cast<double>(weight);
+  }
+
+  tri.z_origin = static_cast<float>(z_origin * inv_area);
+  tri.z_dx = static_cast<float>(z_dx * kSubPixelScale * inv_area);
+  tri.z_dy = static_cast<float>(z_dy * kSubPixelScale * inv_area);
+
+  // Reject the whole triangle if it is behind everything in the coarse tiles it overlaps
+  constexpr int kCoarseSize = kDepthTileSize * kDepthTileFan;
+  bool visible = false;
+  for (int y = min.y(); y < max.y() && !visible; y = nextTile(y, kCoarseSize)) {
+    for (int x = min.x(); x < max.x() && !visible; x = nextTile(x, kCoarseSize)) {
+      visible = !occluded(tri, x, y, 1);
+    }
+  }
+
+  if (!visible) {
+    return;
+  }
+
+  // Then check the fine tiles, most small triangles aren't hidden in any and are drawn in one go
+  bool any_occluded = false;
+  for (int y = min.y(); y < max.y() && !any_occluded; y = nextTile(y, kDepthTileSize)) {
+    for (int x = min.x(); x < max.x() && !any_occluded; x = nextTile(x, kDepthTileSize)) {
+      any_occluded = occluded(tri, x, y, 0);
+    }
+  }
+
+  if (!any_occluded) {
+    rasterize(tri, min, max);
+  } else {
+    // Rasterize the runs of fine tiles that aren't hidden, one band of tiles at a time
+    for (int band_y = min.y(); band_y < max.y();) {
+      const int band_max_y = std::min(nextTile(band_y, kDepthTileSize), max.y());
+      int run_x = min.x();
+
+      for (int x = min.x(); x < max.x();) {
+        const int tile_max_x = std::min(nextTile(x, kDepthTileSize), max.x());
+
+        if (occluded(tri, x, band_y, 0)) {
+          if (run_x < x) {
+            rasterize(tri, Pixel{{run_x, band_y}}, Pixel{{x, band_max_y}});
+          }
+          run_x = tile_max_x;
+        }
+
+        x = tile_max_x;
+      }
+
+      if (run_x < max.x()) {
+        rasterize(tri, Pixel{{run_x, band_y}}, Pixel{{max.x(), band_max_y}});
+      }
+
+      band_y = band_max_y;
+    }
+  }
+
+  updateDepthTiles(tri, min, max);
+}
+
+template <typename Format>
+auto rastrum::BasicFrameBuffer<Format>::index(size_t x, size_t y) const -> size_t {
+  if (_layout == PixelLayout::kLinear) {
+    return (y * _width) + x;
+  }
+
+  constexpr size_t kTileSize = kLayoutTileSize;
+  const size_t tile = ((y / kTileSize) * _layout_tiles_x) + (x / kTileSize);
+  return (tile * kTileSize * kTileSize) + ((y % kTileSize) * kTileSize) + (x % kTileSize);
+}
+
+template <typename Format>
+void rastrum::BasicFrameBuffer<Format>::rasterize(const TriangleSetup& tri, Pixel min, Pixel max) {
+  const auto& [ab, bc, ca] = tri.edges;
+
+#if defined(__SSE2__)
+  // Coverage, depth and color for kSpan pixels are handled at once, with each lane offset by one
+  // pixel from the previous one. Coverage is tested with 32 bit lanes holding each lane's offset
+  // from the span's first pixel, which only fits if the edges aren't too steep.
+  constexpr int kSpan = 4;
+  static_assert(kLayoutTileSize % kSpan == 0, "Spans must not straddle tiles");
+  constexpr int64_t kMaxLaneStep = std::numeric_limits<int32_t>::max() / kSpan;
+  const bool use_spans = std::abs(ab.dx) < kMaxLaneStep && std::abs(bc.dx) < kMaxLaneStep &&
+                         std::abs(ca.dx) < kMaxLaneStep;
+
+  const auto lane_steps = [](int64_t step) {
+    const auto step32 = static_cast<int32_t>(step);
+    return _mm_setr_epi32(0, step32, 2 * step32, 3 * step32);
+  };
+  const __m128i ab_lanes = lane_steps(ab.dx);
+  const __m128i bc_lanes = lane_steps(bc.dx);
+  const __m128i ca_lanes = lane_steps(ca.dx);
+  const __m128i lane_offsets = _mm_setr_epi32(0, 1, 2, 3);
+  const __m128 z_dx = _mm_set1_ps(tri.z_dx);
+
+  // A lane is inside an edge when edge + lane >= 0, or lane > -edge - 1
+  const auto threshold = [](int64_t edge) {
+    constexpr int64_t kLow = std::numeric_limits<int32_t>::lowest();
+    constexpr int64_t kHigh = std::numeric_limits<int32_t>::max();
+    return _mm_set1_epi32(static_cast<int32_t>(std::clamp(-edge - 1, kLow, kHigh)));
+  };
+
+  const SpanWriter<Storage> span_writer(tri.value);
+
+  // Draws the span starting at x, limited to the lanes set in mask
+  const auto draw_span = [&](int x, size_t idx, float z_row, int64_t ab_edge, int64_t bc_edge,
+                             int64_t ca_edge, __m128i mask) {
+    const __m128i covered =
+        _mm_and_si128(_mm_and_si128(mask, _mm_cmpgt_epi32(ab_lanes, threshold(ab_edge))),
+                      _mm_and_si128(_mm_cmpgt_epi32(bc_lanes, threshold(bc_edge)),
+                                    _mm_cmpgt_epi32(ca_lanes, threshold(ca_edge))));
+    if (_mm_movemask_epi8(covered) == 0) {
+      return;
+    }
+
+    // Interpolated in the same way as single pixels so both give identical depths
+    const __m128 lane_x =
+        _mm_cvtepi32_ps(_mm_add_epi32(_mm_set1_epi32(x - tri.origin.x()), lane_offsets));
+    const __m128 z_span = _mm_add_ps(_mm_set1_ps(z_row), _mm_mul_ps(z_dx, lane_x));
 
-  const float area = edge(a, b, c);
+    float* z_ptr = &_z_buffer[idx];
+    const __m128 old_z = _mm_loadu_ps(z_ptr);
+    const __m128 pass = _mm_and_ps(_mm_castsi128_ps(covered), _mm_cmpge_ps(z_span, old_z));
 
-  // Check each point in the bounding box to see if it is in the triangle
-  for (int x = min.x(); x < max.x(); ++x) {
-    for (int y = min.y(); y < max.y(); ++y) {
-      Vector3DF p{{static_cast<float>(x), static_cast<float>(y), 0}};
-      const float ab_edge = edge(a, b, p);
-      const float bc_edge = edge(b, c, p);
-      const float ca_edge = edge(c, a, p);
+    if (_mm_movemask_ps(pass) != 0) {
+      _mm_storeu_ps(z_ptr, _mm_or_ps(_mm_and_ps(pass, z_span), _mm_andnot_ps(pass, old_z)));
+      span_writer.write(&_data[idx], _mm_castps_si128(pass));
+    }
+  };
+  const __m128i all_lanes = _mm_set1_epi32(-1);
+#endif
+
+  // Walk the box row-major so consecutive pixels are adjacent in memory
+  for (int y = min.y(); y < max.y(); ++y) {
+    // The edges are exact integers so can be evaluated at the start of each row then stepped
+    int64_t ab_edge = (ab.dx * min.x()) + (ab.dy * y) + ab.offset;
+    int64_t bc_edge = (bc.dx * min.x()) + (bc.dy * y) + bc.offset;
+    int64_t ca_edge = (ca.dx * min.x()) + (ca.dy * y) + ca.offset;
+
+    // Depth is always evaluated from the same origin so the result for a pixel doesn't depend
+    // on the rectangle being drawn
+    const float z_row = tri.z_origin + (tri.z_dy * static_cast<float>(y - tri.origin.y()));
+    int x = min.x();
+
+#if defined(__SSE2__)
+    if (use_spans && _layout == PixelLayout::kTiled) {
+      // Tiles are padded and a whole number of spans wide, so spans aligned to kSpan always lie
+      // in one tile. Lanes outside the box are masked off rather than drawn one at a time.
+      const int start_x = x - (x % kSpan);
+      ab_edge -= ab.dx * (x - start_x);
+      bc_edge -= bc.dx * (x - start_x);
+      ca_edge -= ca.dx * (x - start_x);
+      const __m128i box_min = _mm_set1_epi32(min.x() - 1);
+      const __m128i box_max = _mm_set1_epi32(max.x());
+      auto idx = index(start_x, y);
+
+      for (x = start_x; x < max.x(); x += kSpan, idx += kSpan) {
+        const __m128i lane_x = _mm_add_epi32(_mm_set1_epi32(x), lane_offsets);
+        const __m128i in_box =
+            _mm_and_si128(_mm_cmpgt_epi32(lane_x, box_min), _mm_cmpgt_epi32(box_max, lane_x));
+        draw_span(x, idx, z_row, ab_edge, bc_edge, ca_edge, in_box);
+
+        ab_edge += ab.dx * kSpan;
+        bc_edge += bc.dx * kSpan;
+        ca_edge += ca.dx * kSpan;
+
+        // Move on to the same row of the next tile
+        if ((x + kSpan) % kLayoutTileSize == 0) {
+          idx += (kLayoutTileSize - 1) * kLayoutTileSize;
+        }
+      }
+      continue;
+    }
+#endif
+
+    // Tiled pixels are only adjacent within a row of a tile, so walk the row a tile at a time
+    while (x < max.x()) {
+      const int run_end = _layout == PixelLayout::kTiled
+                              ? std::min(nextTile(x, kLayoutTileSize), max.x())
+                              : max.x();
+      auto idx = index(x, y);
+
+#if defined(__SSE2__)
+      if (use_spans) {
+        for (; x + kSpan <= run_end; x += kSpan, idx += kSpan) {
+          draw_span(x, idx, z_row, ab_edge, bc_edge, ca_edge, all_lanes);
+
+          ab_edge += ab.dx * kSpan;
+          bc_edge += bc.dx * kSpan;
+          ca_edge += ca.dx * kSpan;
+        }
+      }
+#endif
 
-      const bool inside = (ab_edge >= 0) && (bc_edge >= 0) && (ca_edge >= 0);
-      if (inside) {
-        // Calculate the z position for this point
-        const float ab_bary = ab_edge / area;
-        const float bc_bary = bc_edge / area;
-        const float ca_bary = ca_edge / area;
-        const float z = (a.z() * bc_bary) + (b.z() * ca_bary) + (c.z() * ab_bary);
+      for (; x < run_end; ++x, ++idx) {
+        if ((ab_edge | bc_edge | ca_edge) >= 0) {
+          testAndSet(idx, tri.value, z_row + (tri.z_dx * static_cast<float>(x - tri.origin.x())));
+        }
 
-        set(p.resize<2>().as<int>(), value, z);
+        ab_edge += ab.dx;
+        bc_edge += bc.dx;
+        ca_edge += ca.dx;
       }
     }
   }
 }
 
-void rastrum::FrameBuffer::writeBmp(const std::string& filename) const {
-  const auto result = stbi_write_bmp(filename.c_str(), _width, _height, 4, _data.data());
+template <typename Format>
+void rastrum::BasicFrameBuffer<Format>::writeBmp(const std::string& filename) const {
+  // Only a tiled buffer needs copying into row order first
+  std::vector<Storage> detiled;
+  const Storage* pixels = _data.data();
+  if (_layout == PixelLayout::kTiled) {
+    detiled = linearData();
+    pixels = detiled.data();
+  }
+
+  int result = 0;
+  if constexpr (std::is_same_v<Storage, RGBA>) {
+    result = stbi_write_bmp(filename.c_str(), _width, _height, 4, pixels);
+  } else if constexpr (std::is_same_v<Storage, BGRA>) {
+    result = writeBgraBmp(filename, _width, _height, pixels) ? 1 : 0;
+  } else {
+    std::vector<RGBA> converted(_width * _height);
+    std::transform(pixels, pixels + converted.size(), converted.begin(), Format::unpack);
+    result = stbi_write_bmp(filename.c_str(), _width, _height, 4, converted.data());
+  }
+
   if (result == 0) {
     std::cerr << "Failed to write image: " << result << "\n";
   }
 }
 
-void rastrum::FrameBuffer::writeConsole() const {
+template <typename Format>
+void rastrum::BasicFrameBuffer<Format>::writeConsole() const {
   constexpr auto kBlockChar = "\u2588";
 
   terminal::clear();
 
   for (size_t y = 0; y < _height; ++y) {
     for (size_t x = 0; x < _width; ++x) {
-      terminal::setColor(_data[(y * _width) + x]);
+      terminal::setColor(color((y * _width) + x));
 
       // Intentionally written twice as terminal segments are often
       // roughly twice as tall as they are wide.
@@ -129,7 +639,8 @@ void rastrum::FrameBuffer::writeConsole() const {
   terminal::reset();
 }
 
-void rastrum::FrameBuffer::lineLow(Vector3DF start, Vector3DF end, RGBA value) {
+template <typename Format>
+void rastrum::BasicFrameBuffer<Format>::lineLow(Vector3DF start, Vector3DF end, RGBA value) {
   const auto start_pixel = start.as<int>();
   const auto end_pixel = end.as<int>();
   auto delta = end_pixel - start_pixel;
@@ -158,7 +669,8 @@ void rastrum::FrameBuffer::lineLow(Vector3DF start, Vector3DF end, RGBA value) {
   }
 }
 
-void rastrum::FrameBuffer::lineHigh(Vector3DF start, Vector3DF end, RGBA value) {
+template <typename Format>
+void rastrum::BasicFrameBuffer<Format>::lineHigh(Vector3DF start, Vector3DF end, RGBA value) {
   const auto start_pixel = start.as<int>();
   const auto end_pixel = end.as<int>();
   auto delta = end_pixel - start_pixel;
@@ -187,8 +699,84 @@ void rastrum::FrameBuffer::lineHigh(Vector3DF start, Vector3DF end, RGBA value)
   }
 }
 
-auto rastrum::FrameBuffer::edge(Vector3DF a, Vector3DF b, Vector3DF p) -> float {
-  // See https://dl.acm.org/doi/10.1145/54852.378457
-  const auto val = ((p.x() - a.x()) * (b.y() - a.y()) - (p.y() - a.y()) * (b.x() - a.x()));
-  return val;
-}
\ No newline at end of file
+template <typename Format>
+void rastrum::BasicFrameBuffer<Format>::testAndSet(size_t idx, Storage value, float z) {
+  if (z >= _z_buffer[idx]) {
+    _data[idx] = value;
+    _z_buffer[idx] = z;
+  }
+}
+
+template <typename Format>
+auto rastrum::BasicFrameBuffer<Format>::occluded(const TriangleSetup& tri, int x, int y,
+                                                 int level) -> bool {
+  const size_t tile_x = x / kDepthTileSize;
+  const size_t tile_y = y / kDepthTileSize;
+
+  if (level == 0) {
+    return tri.max_z < _depth_tiles[(tile_y * _depth_tiles_x) + tile_x];
+  }
+
+  const size_t coarse_x = tile_x / kDepthTileFan;
+  const size_t coarse_y = tile_y / kDepthTileFan;
+  const size_t coarse_idx = (coarse_y * _coarse_tiles_x) + coarse_x;
+
+  // Coarse tiles are refreshed from their children when first needed after a change
+  if (_coarse_dirty[coarse_idx] != 0) {
+    const size_t max_x = std::min((coarse_x + 1) * kDepthTileFan, _depth_tiles_x);
+    const size_t max_y = std::min((coarse_y + 1) * kDepthTileFan, _depth_tiles_y);
+    float depth = std::numeric_limits<float>::max();
+
+    for (size_t child_y = coarse_y * kDepthTileFan; child_y < max_y; ++child_y) {
+      for (size_t child_x = coarse_x * kDepthTileFan; child_x < max_x; ++child_x) {
+        depth = std::min(depth, _depth_tiles[(child_y * _depth_tiles_x) + child_x]);
+      }
+    }
+
+    _coarse_tiles[coarse_idx] = depth;
+    _coarse_dirty[coarse_idx] = 0;
+  }
+
+  return tri.max_z < _coarse_tiles[coarse_idx];
+}
+
+template <typename Format>
+void rastrum::BasicFrameBuffer<Format>::updateDepthTiles(const TriangleSetup& tri, Pixel min,
+                                                         Pixel max) {
+  for (int tile_y = min.y() / kDepthTileSize; tile_y * kDepthTileSize < max.y(); ++tile_y) {
+    for (int tile_x = min.x() / kDepthTileSize; tile_x * kDepthTileSize < max.x(); ++tile_x) {
+      auto& tile = _depth_tiles[(tile_y * _depth_tiles_x) + tile_x];
+
+      // A tile the triangle fully covers now holds nothing further back than the triangle.
+      // Coverage is exact, and as the triangle is convex testing the corners is enough.
+      const int x0 = tile_x * kDepthTileSize;
+      const int y0 = tile_y * kDepthTileSize;
+      const int x1 = std::min(x0 + kDepthTileSize, static_cast<int>(_width)) - 1;
+      const int y1 = std::min(y0 + kDepthTileSize, static_cast<int>(_height)) - 1;
+
+      if (x0 < min.x() || y0 < min.y() || x1 >= max.x() || y1 >= max.y() ||
+          tri.min_z <= tile) {
+        continue;
+      }
+
+      bool covered = true;
+      for (const auto corner_x : {x0, x1}) {
+        for (const auto corner_y : {y0, y1}) {
+          for (const auto& edge : tri.edges) {
+            covered = covered && ((edge.dx * corner_x) + (edge.dy * corner_y) + edge.offset) >= 0;
+          }
+        }
+      }
+
+      if (covered) {
+        tile = tri.min_z;
+        _coarse_dirty[((tile_y / kDepthTileFan) * _coarse_tiles_x) + (tile_x / kDepthTileFan)] = 1;
+      }
+    }
+  }
+}
+
+template class rastrum::BasicFrameBuffer<rastrum::RGBA8>;
+template class rastrum::BasicFrameBuffer<rastrum::BGRA8>;
+template class rastrum::BasicFrameBuffer<rastrum::RGB565>;
+template class rastrum::BasicFrameBuffer<rastrum::RGBA32F>;
@@ -0,0 +1,389 @@
+#include "rastrum/Geometry.h"
+
+#include <algorithm>
+#include <cmath>
+#include <span>
+
+namespace {
+/** Indicates whether every coordinate of a vertex is a number and not infinite. */
+auto isFinite(const rastrum::Vector3DF& vert) -> bool {
+  return std::isfinite(vert.x()) && std::isfinite(vert.y()) && std::isfinite(vert.z());
+}
+}  // namespace
+
+auto rastrum::ClipBounds::contains(const Vector3DF& point) const -> bool {
+  return point.x() >= min.x() && point.x() <= max.x() && point.y() >= min.y() &&
+         point.y() <= max.y() && point.z() >= min.z() && point.z() <= max.z();
+}
+
+auto rastrum::clip(Vector3DF a, Vector3DF b, Vector3DF c, const ClipBounds& bounds)
+    -> ClippedPolygon {
+  // Sutherland-Hodgman, clipping the polygon against one plane at a time
+  ClippedPolygon polygon{{a, b, c}, 3};
+
+  for (size_t axis = 0; axis < 3; ++axis) {
+    for (const bool is_max : {false, true}) {
+      const float limit = is_max ? bounds.max[axis] : bounds.min[axis];
+      const auto inside = [&](const Vector3DF& vert) {
+        return is_max ? vert[axis] <= limit : vert[axis] >= limit;
+      };
+
+      ClippedPolygon output;
+      for (size_t idx = 0; idx < polygon.count; ++idx) {
+        const auto& current = polygon.verts[idx];
+        const auto& next = polygon.verts[(idx + 1) % polygon.count];
+
+        if (inside(current)) {
+          output.verts[output.count++] = current;
+        }
+
+        if (inside(current) != inside(next)) {
+          // Add the point where the edge crosses the plane
+          const float t = (limit - current[axis]) / (next[axis] - current[axis]);
+          Vector3DF crossing;
+          for (size_t coord = 0; coord < 3; ++coord) {
+            crossing[coord] = current[coord] + (t * (next[coord] - current[coord]));
+          }
+          crossing[axis] = limit;
+          output.verts[output.count++] = crossing;
+        }
+      }
+
+      polygon = output;
+    }
+  }
+
+  return polygon;
+}
+
+auto rastrum::clipDepth(Vector4DF a, Vector4DF b, Vector4DF c, float min_z, float max_z)
+    -> ClippedPolygon {
+  // Sutherland-Hodgman, each plane is where a dot product with the homogeneous point is zero
+  std::array<Vector4DF, 3> planes{};
+  size_t plane_count = 0;
+  planes[plane_count++] = Vector4DF{{0, 0, 0, 1}};
+  if (std::isfinite(min_z)) {
+    planes[plane_count++] = Vector4DF{{0, 0, 1, -min_z}};
+  }
+  if (std::isfinite(max_z)) {
+    planes[plane_count++] = Vector4DF{{0, 0, -1, max_z}};
+  }
+
+  // Each plane can add at most one vertex
+  std::array<Vector4DF, 6> polygon{a, b, c};
+  size_t count = 3;
+
+  for (size_t plane_idx = 0; plane_idx < plane_count; ++plane_idx) {
+    // w is kept at kMinClipW or more, rather than just in front of the viewer, to divide safely
+    const auto& plane = planes[plane_idx];
+    const float offset = plane_idx == 0 ? -kMinClipW : 0;
+    const auto distance = [&](const Vector4DF& vert) { return plane.dot(vert) + offset; };
+
+    std::array<Vector4DF, 6> output{};
+    size_t output_count = 0;
+    for (size_t idx = 0; idx < count; ++idx) {
+      const auto& current = polygon[idx];
+      const auto& next = polygon[(idx + 1) % count];
+      const auto current_distance = distance(current);
+      const auto next_distance = distance(next);
+
+      if (current_distance >= 0) {
+        output[output_count++] = current;
+      }
+
+      if ((current_distance >= 0) != (next_distance >= 0)) {
+        // Add the point where the edge crosses the plane
+        const float t = current_distance / (current_distance - next_distance);
+        Vector4DF crossing;
+        for (size_t coord = 0; coord < 4; ++coord) {
+          crossing[coord] = current[coord] + (t * (next[coord] - current[coord]));
+        }
+        output[output_count++] = crossing;
+      }
+    }
+
+    polygon = output;
+    count = output_count;
+  }
+
+  ClippedPolygon res;
+  for (size_t idx = 0; idx < count; ++idx) {
+    const auto& vert = polygon[idx];
+    res.verts[res.count++] =
+        Vector3DF{{vert.x() / vert.w(), vert.y() / vert.w(), vert.z() / vert.w()}};
+  }
+  return res;
+}
+
+rastrum::Frustum::Frustum(const Matrix4F& transform, const ClipBounds& bounds) {
+  // Row r of the transform gives a point's homogeneous coordinate r, and screen coordinate r is
+  // that divided by w. With w > 0, min <= x / w is the same as x - min * w >= 0 which is a plane.
+  const auto row = [&](size_t idx) {
+    return Vector4DF{{transform(idx, 0), transform(idx, 1), transform(idx, 2), transform(idx, 3)}};
+  };
+  const auto w_row = row(3);
+
+  // By Cauchy-Binet, the on screen winding of a face is the sign of its normal dotted with a
+  // vector made from the 3x3 minors of the x, y and w rows, see _view
+  const auto x_row = row(0);
+  const auto y_row = row(1);
+  const auto minor = [&](size_t skip) {
+    std::array<size_t, 3> cols{};
+    for (size_t col = 0, idx = 0; col < 4; ++col) {
+      if (col != skip) {
+        cols[idx++] = col;
+      }
+    }
+
+    const auto pick = [&](const Vector4DF& row) {
+      return Vector3DF{{row[cols[0]], row[cols[1]], row[cols[2]]}};
+    };
+    return pick(x_row).dot(pick(y_row).cross(pick(w_row)));
+  };
+  _view = Vector4DF{{minor(0), -minor(1), minor(2), minor(3)}};
+
+  _planes[_count++] = w_row;
+  for (size_t axis = 0; axis < 3; ++axis) {
+    const auto axis_row = row(axis);
+
+    for (const bool is_max : {false, true}) {
+      const float limit = is_max ? bounds.max[axis] : bounds.min[axis];
+      if (!std::isfinite(limit)) {
+        continue;
+      }
+
+      auto& plane = _planes[_count++];
+      for (size_t coord = 0; coord < 4; ++coord) {
+        const auto offset = axis_row[coord] - (limit * w_row[coord]);
+        plane[coord] = is_max ? -offset : offset;
+      }
+    }
+  }
+}
+
+auto rastrum::Frustum::classify(const Vector3DF& min, const Vector3DF& max) const
+    -> Containment {
+  auto result = Containment::kInside;
+
+  for (size_t idx = 0; idx < _count; ++idx) {
+    const auto& plane = _planes[idx];
+
+    // The box's corners furthest along and against the plane's normal
+    float nearest = plane.w();
+    float furthest = plane.w();
+    for (size_t axis = 0; axis < 3; ++axis) {
+      const auto low = plane[axis] * min[axis];
+      const auto high = plane[axis] * max[axis];
+      nearest += std::min(low, high);
+      furthest += std::max(low, high);
+    }
+
+    if (furthest < 0) {
+      return Containment::kOutside;
+    }
+    if (nearest < 0) {
+      result = Containment::kIntersects;
+    }
+  }
+
+  return result;
+}
+
+auto rastrum::Frustum::classify(const Vector3DF& center, float radius) const -> Containment {
+  auto result = Containment::kInside;
+
+  for (size_t idx = 0; idx < _count; ++idx) {
+    const auto& plane = _planes[idx];
+    const auto normal = plane.resize<3>();
+    const auto distance = normal.dot(center) + plane.w();
+    const auto extent = radius * normal.length();
+
+    if (distance < -extent) {
+      return Containment::kOutside;
+    }
+    if (distance < extent) {
+      result = Containment::kIntersects;
+    }
+  }
+
+  return result;
+}
+
+auto rastrum::Frustum::facesAway(const Vector3DF& center, float radius,
+                                 const NormalCone& cone) const -> bool {
+  if (cone.cos_angle <= 0) {
+    return false;
+  }
+
+  // Within the sphere the view vector stays within a cone around its value at the center
+  const Vector3DF view{{_view.x() + (_view.w() * center.x()), _view.y() + (_view.w() * center.y()),
+                        _view.z() + (_view.w() * center.z())}};
+  const auto distance = view.length();
+  const auto spread = std::abs(_view.w()) * radius;
+  if (distance <= spread) {
+    return false;
+  }
+
+  // Every face faces away if the normal and view cones are less than 90 degrees apart at their
+  // closest, that is the angle between their axes plus both half angles is under 90 degrees
+  const auto sin_view = spread / distance;
+  const auto cos_view = std::sqrt(1 - (sin_view * sin_view));
+  const auto sin_normal = std::sqrt(1 - (cone.cos_angle * cone.cos_angle));
+  const auto cos_sum = (cone.cos_angle * cos_view) - (sin_normal * sin_view);
+  const auto sin_sum = (sin_normal * cos_view) + (cone.cos_angle * sin_view);
+
+  return cos_sum > 0 && cone.axis.dot(view) > sin_sum * distance;
+}
+
+auto rastrum::CullStats::culled() const -> size_t {
+  return off_screen + outside_depth + degenerate + back_face + no_samples;
+}
+
+rastrum::GeometryStage::GeometryStage(size_t width, size_t height)
+    : _max_x(static_cast<float>(width) - 1),
+      _max_y(static_cast<float>(height) - 1),
+      _guard_band{Vector3DF{{-kGuardBand, -kGuardBand, -std::numeric_limits<float>::infinity()}},
+                  Vector3DF{{_max_x + kGuardBand, _max_y + kGuardBand,
+                             std::numeric_limits<float>::infinity()}}} {
+}
+
+void rastrum::GeometryStage::setDepthRange(float min_z, float max_z) {
+  _min_z = min_z;
+  _max_z = max_z;
+}
+
+auto rastrum::GeometryStage::viewport() const -> ClipBounds {
+  return {Vector3DF{{0, 0, _min_z}}, Vector3DF{{_max_x, _max_y, _max_z}}};
+}
+
+auto rastrum::GeometryStage::cullCluster(const Frustum& frustum, const Vector3DF& center,
+                                         float radius, const NormalCone& cone, size_t face_count)
+    -> Cull {
+  if (frustum.classify(center, radius) == Containment::kOutside) {
+    _stats.submitted += face_count;
+    _stats.off_screen += face_count;
+    return Cull::kOffScreen;
+  }
+
+  if (frustum.facesAway(center, radius, cone)) {
+    _stats.submitted += face_count;
+    _stats.back_face += face_count;
+    return Cull::kBackFace;
+  }
+
+  return Cull::kNone;
+}
+
+auto rastrum::GeometryStage::cull(Vector3DF a, Vector3DF b, Vector3DF c) -> Cull {
+  ++_stats.submitted;
+  return record(classify(a, b, c));
+}
+
+auto rastrum::GeometryStage::classify(Vector3DF a, Vector3DF b, Vector3DF c) const -> Cull {
+  // transformPoints marks vertices behind the viewer as NaN, they can't be placed on screen
+  if (!isFinite(a) || !isFinite(b) || !isFinite(c)) {
+    return Cull::kOutsideDepth;
+  }
+
+  const auto [min_x, max_x] = std::minmax({a.x(), b.x(), c.x()});
+  const auto [min_y, max_y] = std::minmax({a.y(), b.y(), c.y()});
+
+  if (max_x < 0 || max_y < 0 || min_x > _max_x || min_y > _max_y) {
+    return Cull::kOffScreen;
+  }
+
+  const auto [min_z, max_z] = std::minmax({a.z(), b.z(), c.z()});
+  if (max_z < _min_z || min_z > _max_z) {
+    return Cull::kOutsideDepth;
+  }
+
+  // Twice the signed area, positive when wound clockwise on screen
+  const float area = ((c.x() - a.x()) * (b.y() - a.y())) - ((c.y() - a.y()) * (b.x() - a.x()));
+
+  if (area == 0) {
+    return Cull::kDegenerate;
+  }
+
+  if (area < 0) {
+    return Cull::kBackFace;
+  }
+
+  return coversSamples(min_x, max_x, min_y, max_y) ? Cull::kNone : Cull::kNoSamples;
+}
+
+auto rastrum::GeometryStage::classify(const ClippedPolygon& polygon) const -> Cull {
+  const auto verts = std::span(polygon.verts).first(polygon.count);
+  if (verts.size() < 3 || !std::all_of(verts.begin(), verts.end(), isFinite)) {
+    return Cull::kOutsideDepth;
+  }
+
+  auto min = verts[0];
+  auto max = min;
+  for (const auto& vert : verts) {
+    min = rastrum::min(min, vert);
+    max = rastrum::max(max, vert);
+  }
+
+  if (max.x() < 0 || max.y() < 0 || min.x() > _max_x || min.y() > _max_y) {
+    return Cull::kOffScreen;
+  }
+
+  // Twice the signed area, summed over a fan of triangles, as above
+  float area = 0;
+  for (size_t idx = 2; idx < verts.size(); ++idx) {
+    const auto& b = verts[idx - 1];
+    const auto& c = verts[idx];
+    area += ((c.x() - verts[0].x()) * (b.y() - verts[0].y())) -
+            ((c.y() - verts[0].y()) * (b.x() - verts[0].x()));
+  }
+
+  if (area == 0) {
+    return Cull::kDegenerate;
+  }
+
+  if (area < 0) {
+    return Cull::kBackFace;
+  }
+
+  return coversSamples(min.x(), max.x(), min.y(), max.y()) ? Cull::kNone : Cull::kNoSamples;
+}
+
+auto rastrum::GeometryStage::coversSamples(float min_x, float max_x, float min_y, float max_y)
+    -> bool {
+  // Samples are at whole coordinates, so a box that contains no whole x or y covers nothing.
+  // The box is padded as the rasterizer may snap vertices onto a sample.
+  constexpr float kSnap = 1.0F / (1 << kSubPixelBits);
+  return std::ceil(min_x - kSnap) <= std::floor(max_x + kSnap) &&
+         std::ceil(min_y - kSnap) <= std::floor(max_y + kSnap);
+}
+
+auto rastrum::GeometryStage::record(Cull result) -> Cull {
+  switch (result) {
+    case Cull::kNone:
+      break;
+    case Cull::kOffScreen:
+      ++_stats.off_screen;
+      break;
+    case Cull::kOutsideDepth:
+      ++_stats.outside_depth;
+      break;
+    case Cull::kDegenerate:
+      ++_stats.degenerate;
+      break;
+    case Cull::kBackFace:
+      ++_stats.back_face;
+      break;
+    case Cull::kNoSamples:
+      ++_stats.no_samples;
+      break;
+  }
+  return result;
+}
+
+auto rastrum::GeometryStage::stats() const -> const CullStats& {
+  return _stats;
+}
+
+void rastrum::GeometryStage::resetStats() {
+  _stats = CullStats{};
+}
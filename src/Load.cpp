@@ -0,0 +1,34 @@
+#include "rastrum/Load.h"
+
+#include "MappedFile.h"
+#include "rastrum/Obj.h"
+#include "rastrum/Ply.h"
+#include "rastrum/Stl.h"
+
+auto rastrum::detectFormat(std::string_view contents) -> ModelFormat {
+  if (ply::isPly(contents)) {
+    return ModelFormat::kPly;
+  }
+
+  // Some binary STL headers also start with "solid", so check the size first
+  if (stl::isBinary(contents) || contents.starts_with("solid")) {
+    return ModelFormat::kStl;
+  }
+
+  return ModelFormat::kObj;
+}
+
+auto rastrum::load(const std::string& filename, VertexLayout layout, size_t threads) -> Model {
+  // Only the first pages of the file are read to detect its format
+  const auto format = detectFormat(MappedFile(filename).data());
+
+  switch (format) {
+    case ModelFormat::kStl:
+      return stl::load(filename, layout, threads);
+    case ModelFormat::kPly:
+      return ply::load(filename, layout, threads);
+    case ModelFormat::kObj:
+      break;
+  }
+  return obj::load(filename, layout, threads);
+}
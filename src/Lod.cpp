@@ -0,0 +1,469 @@
+#include "rastrum/Lod.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <queue>
+
+namespace {
+/**
+ * Boundary edges are held in place by planes through them, perpendicular to their face. They're
+ * weighted above the faces' planes so open edges keep their shape.
+ */
+constexpr double kBoundaryWeight = 10;
+
+/**
+ * Sums the squared distances of a point to a set of planes, each weighted by the area it came
+ * from, as a symmetric 4x4 matrix stored as its upper triangle.
+ */
+class Quadric {
+ public:
+  Quadric() = default;
+
+  /** The quadric of a plane with a unit normal, through point. */
+  Quadric(const rastrum::Vector3DF& normal, const rastrum::Vector3DF& point, double weight)
+      : _weight(weight) {
+    const std::array<double, 4> plane{normal.x(), normal.y(), normal.z(),
+                                      -static_cast<double>(normal.dot(point))};
+    size_t idx = 0;
+    for (size_t row = 0; row < 4; ++row) {
+      for (size_t col = row; col < 4; ++col) {
+        _terms[idx++] = plane[row] * plane[col] * weight;
+      }
+    }
+  }
+
+  auto operator+=(const Quadric& other) -> Quadric& {
+    for (size_t idx = 0; idx < _terms.size(); ++idx) {
+      _terms[idx] += other._terms[idx];
+    }
+    _weight += other._weight;
+    return *this;
+  }
+
+  /** The weighted sum of squared distances from point to the planes. */
+  auto error(const rastrum::Vector3DF& point) const -> double {
+    const std::array<double, 4> vec{point.x(), point.y(), point.z(), 1};
+    double sum = 0;
+    size_t idx = 0;
+    for (size_t row = 0; row < 4; ++row) {
+      for (size_t col = row; col < 4; ++col) {
+        sum += _terms[idx++] * vec[row] * vec[col] * (row == col ? 1 : 2);
+      }
+    }
+    return std::max(sum, 0.0);
+  }
+
+  /** The total weight of the planes. */
+  auto weight() const -> double {
+    return _weight;
+  }
+
+ private:
+  std::array<double, 10> _terms{};
+  double _weight = 0;
+};
+
+/** Moving one end of an edge onto the other, with the vertex versions it was costed for. */
+struct Collapse {
+  double cost;
+  uint32_t from;
+  uint32_t to;
+  uint32_t from_version;
+  uint32_t to_version;
+
+  auto operator>(const Collapse& other) const -> bool {
+    return cost > other.cost;
+  }
+};
+
+/** Collapses a model's edges, cheapest first, keeping the faces left in step. */
+class Simplifier {
+ public:
+  explicit Simplifier(const rastrum::Model& model)
+      : _positions(model.vertices().begin(), model.vertices().end()),
+        _quadrics(_positions.size()),
+        _vertex_faces(_positions.size()),
+        _versions(_positions.size(), 0),
+        _removed(_positions.size(), false),
+        _live_faces(model.face_count()),
+        _blocked(_positions.size()) {
+    model.vert_indices().visit([&](auto indices) {
+      _indices.assign(indices.begin(), indices.end());
+    });
+    _face_live.assign(model.face_count(), true);
+
+    // Faces that use a vertex twice have no area and would block collapses near them, so drop them
+    for (size_t face = 0; face < model.face_count(); ++face) {
+      const auto a = corner_vertex(face, 0);
+      const auto b = corner_vertex(face, 1);
+      const auto c = corner_vertex(face, 2);
+      if (a == b || b == c || c == a) {
+        _face_live[face] = false;
+        --_live_faces;
+        continue;
+      }
+
+      for (size_t corner = 0; corner < rastrum::kModelFaceSize; ++corner) {
+        _vertex_faces[corner_vertex(face, corner)].push_back(static_cast<uint32_t>(face));
+      }
+    }
+
+    for (size_t face = 0; face < model.face_count(); ++face) {
+      if (_face_live[face]) {
+        addFaceQuadrics(face);
+      }
+    }
+
+    for (size_t face = 0; face < model.face_count(); ++face) {
+      if (!_face_live[face]) {
+        continue;
+      }
+
+      for (size_t corner = 0; corner < rastrum::kModelFaceSize; ++corner) {
+        const auto from = corner_vertex(face, corner);
+        const auto to = corner_vertex(face, (corner + 1) % rastrum::kModelFaceSize);
+        if (from < to || boundary(face, from, to)) {
+          push(from, to);
+        }
+      }
+    }
+  }
+
+  /** Collapses edges until there are at most target_faces faces or none can be collapsed. */
+  void collapseTo(size_t target_faces) {
+    while (_live_faces > target_faces && !_queue.empty()) {
+      const auto collapse = _queue.top();
+      _queue.pop();
+
+      if (!current(collapse)) {
+        continue;
+      }
+
+      // The collapse may become possible once the faces around it change, so keep it for then
+      if (!collapsible(collapse.from, collapse.to)) {
+        _blocked[collapse.from].push_back(collapse);
+        continue;
+      }
+
+      apply(collapse.from, collapse.to);
+      const auto weight = _quadrics[collapse.to].weight();
+      if (weight > 0) {
+        _error = std::max(_error, std::sqrt(collapse.cost / weight));
+      }
+    }
+  }
+
+  auto faceCount() const -> size_t {
+    return _live_faces;
+  }
+
+  /** The largest root mean squared plane distance of any collapse so far. */
+  auto error() const -> float {
+    return static_cast<float>(_error);
+  }
+
+  /** Copies the remaining faces and the vertices they use into a model. */
+  auto snapshot(const rastrum::Model& source) const -> rastrum::Model {
+    constexpr auto kUnmapped = std::numeric_limits<uint32_t>::max();
+    std::vector<uint32_t> remap(_positions.size(), kUnmapped);
+    std::vector<rastrum::Vector3DF> vertices;
+    std::vector<uint32_t> indices;
+    indices.reserve(_live_faces * rastrum::kModelFaceSize);
+
+    for (size_t face = 0; face < _face_live.size(); ++face) {
+      if (!_face_live[face]) {
+        continue;
+      }
+
+      for (size_t corner = 0; corner < rastrum::kModelFaceSize; ++corner) {
+        const auto vert = corner_vertex(face, corner);
+        if (remap[vert] == kUnmapped) {
+          remap[vert] = static_cast<uint32_t>(vertices.size());
+          vertices.push_back(_positions[vert]);
+        }
+        indices.push_back(remap[vert]);
+      }
+    }
+
+    const auto vertex_count = vertices.size();
+    rastrum::Model model(std::move(vertices),
+                         rastrum::IndexBuffer(std::move(indices), vertex_count), source.layout());
+    if (source.precomputed()) {
+      model.precompute();
+    }
+    return model;
+  }
+
+ private:
+  auto corner_vertex(size_t face, size_t corner) const -> uint32_t {
+    return _indices[(face * rastrum::kModelFaceSize) + corner];
+  }
+
+  auto contains(size_t face, uint32_t vert) const -> bool {
+    for (size_t corner = 0; corner < rastrum::kModelFaceSize; ++corner) {
+      if (corner_vertex(face, corner) == vert) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /** Indicates whether face is the only face with an edge between from and to. */
+  auto boundary(size_t face, uint32_t from, uint32_t to) const -> bool {
+    return std::none_of(_vertex_faces[from].begin(), _vertex_faces[from].end(),
+                        [&](uint32_t other) { return other != face && contains(other, to); });
+  }
+
+  /** The unnormalized normal of a face. */
+  auto faceNormal(size_t face) const -> rastrum::Vector3DF {
+    const auto first = corner_vertex(face, 0);
+    return faceNormal(face, first, first);
+  }
+
+  /** The unnormalized normal a face would have if one of its vertices moved onto another. */
+  auto faceNormal(size_t face, uint32_t moved, uint32_t moved_to) const -> rastrum::Vector3DF {
+    std::array<rastrum::Vector3DF, rastrum::kModelFaceSize> corners;
+    for (size_t corner = 0; corner < rastrum::kModelFaceSize; ++corner) {
+      const auto vert = corner_vertex(face, corner);
+      corners[corner] = _positions[vert == moved ? moved_to : vert];
+    }
+    return (corners[1] - corners[0]).cross(corners[2] - corners[0]);
+  }
+
+  void addFaceQuadrics(size_t face) {
+    const auto normal = faceNormal(face);
+    const auto double_area = normal.length();
+    if (double_area == 0) {
+      return;
+    }
+
+    const auto unit = normal.normalize();
+    const Quadric quadric(unit, _positions[corner_vertex(face, 0)], double_area / 2);
+    for (size_t corner = 0; corner < rastrum::kModelFaceSize; ++corner) {
+      _quadrics[corner_vertex(face, corner)] += quadric;
+    }
+
+    for (size_t corner = 0; corner < rastrum::kModelFaceSize; ++corner) {
+      const auto from = corner_vertex(face, corner);
+      const auto to = corner_vertex(face, (corner + 1) % rastrum::kModelFaceSize);
+      if (!boundary(face, from, to)) {
+        continue;
+      }
+
+      const auto edge = _positions[to] - _positions[from];
+      const auto length = edge.length();
+      const Quadric edge_quadric(edge.cross(unit).normalize(), _positions[from],
+                                 length * length * kBoundaryWeight);
+      _quadrics[from] += edge_quadric;
+      _quadrics[to] += edge_quadric;
+    }
+  }
+
+  /** Indicates whether a queued collapse is still between two vertices with the same quadrics. */
+  auto current(const Collapse& collapse) const -> bool {
+    return !_removed[collapse.from] && !_removed[collapse.to] &&
+           _versions[collapse.from] == collapse.from_version &&
+           _versions[collapse.to] == collapse.to_version;
+  }
+
+  /** Queues the cheaper direction of collapsing the edge between a and b. */
+  void push(uint32_t a, uint32_t b) {
+    auto combined = _quadrics[a];
+    combined += _quadrics[b];
+    const auto a_to_b = combined.error(_positions[b]);
+    const auto b_to_a = combined.error(_positions[a]);
+
+    if (a_to_b <= b_to_a) {
+      _queue.push({a_to_b, a, b, _versions[a], _versions[b]});
+    } else {
+      _queue.push({b_to_a, b, a, _versions[b], _versions[a]});
+    }
+  }
+
+  /** The faces using vert, forgetting any dropped since they were listed. */
+  auto liveFaces(uint32_t vert) -> const std::vector<uint32_t>& {
+    auto& faces = _vertex_faces[vert];
+    faces.erase(std::remove_if(faces.begin(), faces.end(),
+                               [&](uint32_t face) { return !_face_live[face]; }),
+                faces.end());
+    return faces;
+  }
+
+  /** The vertices that share a live face with vert, other than vert itself. */
+  void neighbours(uint32_t vert, std::vector<uint32_t>& out) {
+    out.clear();
+    for (const auto face : liveFaces(vert)) {
+      for (size_t corner = 0; corner < rastrum::kModelFaceSize; ++corner) {
+        const auto other = corner_vertex(face, corner);
+        if (other != vert && std::find(out.begin(), out.end(), other) == out.end()) {
+          out.push_back(other);
+        }
+      }
+    }
+  }
+
+  /**
+   * Checks the link condition, that from and to only share the neighbours opposite their edge so
+   * the collapse can't pinch the surface, and that no face of from would flip over.
+   */
+  auto collapsible(uint32_t from, uint32_t to) -> bool {
+    size_t shared_faces = 0;
+    for (const auto face : liveFaces(from)) {
+      if (contains(face, to)) {
+        ++shared_faces;
+      } else if (faceNormal(face).dot(faceNormal(face, from, to)) <= 0) {
+        return false;
+      }
+    }
+
+    if (shared_faces == 0) {
+      return false;
+    }
+
+    neighbours(from, _from_neighbours);
+    neighbours(to, _to_neighbours);
+    const auto common = std::count_if(
+        _from_neighbours.begin(), _from_neighbours.end(), [&](uint32_t vert) {
+          return std::find(_to_neighbours.begin(), _to_neighbours.end(), vert) !=
+                 _to_neighbours.end();
+        });
+
+    return static_cast<size_t>(common) == shared_faces;
+  }
+
+  /** Moves from onto to, dropping the faces between them. */
+  void apply(uint32_t from, uint32_t to) {
+    for (const auto face : liveFaces(from)) {
+      if (contains(face, to)) {
+        _face_live[face] = false;
+        --_live_faces;
+        continue;
+      }
+
+      for (size_t corner = 0; corner < rastrum::kModelFaceSize; ++corner) {
+        auto& vert = _indices[(face * rastrum::kModelFaceSize) + corner];
+        vert = vert == from ? to : vert;
+      }
+      _vertex_faces[to].push_back(face);
+    }
+
+    _removed[from] = true;
+    _vertex_faces[from].clear();
+    _quadrics[to] += _quadrics[from];
+    ++_versions[to];
+
+    _blocked[from].clear();
+    _blocked[to].clear();
+
+    // Requeue every edge around to with its new quadric. The faces around to's neighbours changed
+    // too, so give their blocked collapses another go.
+    neighbours(to, _to_neighbours);
+    for (const auto other : _to_neighbours) {
+      push(to, other);
+
+      for (const auto& collapse : _blocked[other]) {
+        if (current(collapse)) {
+          _queue.push(collapse);
+        }
+      }
+      _blocked[other].clear();
+    }
+  }
+
+  std::vector<rastrum::Vector3DF> _positions;
+  std::vector<Quadric> _quadrics;
+  std::vector<uint32_t> _indices;
+  std::vector<bool> _face_live;
+  /** The faces using each vertex, which may include faces dropped since. */
+  std::vector<std::vector<uint32_t>> _vertex_faces;
+  /** Bumped whenever a vertex's quadric changes, so queued collapses costed before are skipped. */
+  std::vector<uint32_t> _versions;
+  std::vector<bool> _removed;
+  size_t _live_faces;
+  double _error = 0;
+  std::priority_queue<Collapse, std::vector<Collapse>, std::greater<>> _queue;
+  /** Collapses from each vertex that failed collapsible() with the faces as they were. */
+  std::vector<std::vector<Collapse>> _blocked;
+  std::vector<uint32_t> _from_neighbours;
+  std::vector<uint32_t> _to_neighbours;
+};
+}  // namespace
+
+auto rastrum::simplify(const Model& model, size_t target_faces) -> Lod {
+  Simplifier simplifier(model);
+  simplifier.collapseTo(target_faces);
+  return {simplifier.snapshot(model), simplifier.error()};
+}
+
+rastrum::LodChain::LodChain(const Model& model, size_t min_faces) {
+  _levels.push_back({model, 0});
+
+  const auto vertices = model.vertices();
+  if (!vertices.empty()) {
+    auto min = vertices.front();
+    auto max = min;
+    for (const auto& vert : vertices) {
+      min = rastrum::min(min, vert);
+      max = rastrum::max(max, vert);
+    }
+
+    const auto sum = min + max;
+    _center = Vector3DF{{sum.x() / 2, sum.y() / 2, sum.z() / 2}};
+    for (const auto& vert : vertices) {
+      _radius = std::max(_radius, (vert - _center).length());
+    }
+  }
+
+  Simplifier simplifier(model);
+  for (auto target = model.face_count() / kLodReduction; target >= min_faces;
+       target = simplifier.faceCount() / kLodReduction) {
+    const auto before = simplifier.faceCount();
+    simplifier.collapseTo(target);
+    if (simplifier.faceCount() == before) {
+      break;
+    }
+
+    _levels.push_back({simplifier.snapshot(model), simplifier.error()});
+    if (simplifier.faceCount() > target) {
+      break;
+    }
+  }
+}
+
+auto rastrum::LodChain::levels() const -> std::span<const Lod> {
+  return _levels;
+}
+
+auto rastrum::LodChain::select(const Matrix4F& transform, float max_error) const -> const Lod& {
+  if (_radius == 0) {
+    return _levels.back();
+  }
+
+  // Measure the pixels per model unit across the bounding sphere along each axis
+  float scale = 0;
+  for (size_t axis = 0; axis < 3; ++axis) {
+    std::array<Vector4DF, 2> ends;
+    for (size_t end = 0; end < ends.size(); ++end) {
+      auto point = _center;
+      point[axis] += end == 0 ? -_radius : _radius;
+      ends[end] = transform * Vector4DF{{point.x(), point.y(), point.z(), 1}};
+      if (!(ends[end].w() > 0)) {
+        return _levels.front();
+      }
+    }
+
+    const auto dx = (ends[1].x() / ends[1].w()) - (ends[0].x() / ends[0].w());
+    const auto dy = (ends[1].y() / ends[1].w()) - (ends[0].y() / ends[0].w());
+    scale = std::max(scale, std::sqrt((dx * dx) + (dy * dy)) / (2 * _radius));
+  }
+
+  for (auto level = _levels.rbegin(); level != _levels.rend(); ++level) {
+    if (level->error * scale <= max_error) {
+      return *level;
+    }
+  }
+  return _levels.front();
+}
@@ -0,0 +1,72 @@
+#include "MappedFile.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <iostream>
+
+rastrum::MappedFile::MappedFile(const std::string& filename) {
+  if (const auto* failed = map(filename)) {
+    std::cerr << failed << filename << "\n";
+    exit(1);
+  }
+}
+
+rastrum::MappedFile::MappedFile(const std::string& filename, std::error_code& error) {
+  error.clear();
+  if (map(filename) != nullptr) {
+    error.assign(errno, std::generic_category());
+  }
+}
+
+auto rastrum::MappedFile::map(const std::string& filename) -> const char* {
+  const int file = open(filename.c_str(), O_RDONLY);
+  if (file < 0) {
+    return "Failed to open: ";
+  }
+
+  // Keep errno from the failed call rather than from closing the file
+  const auto fail = [file](const char* step) {
+    const int error = errno;
+    close(file);
+    errno = error;
+    return step;
+  };
+
+  struct stat info {};
+  if (fstat(file, &info) != 0) {
+    return fail("Failed to stat: ");
+  }
+
+  const auto size = static_cast<size_t>(info.st_size);
+
+  // Empty files can't be mapped, they are just an empty view
+  if (size > 0) {
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+    if (mapping == MAP_FAILED) {
+      return fail("Failed to map: ");
+    }
+
+    // Files are almost always read front to back, so ask for aggressive read ahead
+    madvise(mapping, size, MADV_SEQUENTIAL);
+    _data = static_cast<const char*>(mapping);
+    _size = size;
+  }
+
+  // The mapping keeps the file alive
+  close(file);
+  return nullptr;
+}
+
+rastrum::MappedFile::~MappedFile() {
+  if (_data != nullptr) {
+    munmap(const_cast<char*>(_data), _size);
+  }
+}
+
+auto rastrum::MappedFile::data() const -> std::string_view {
+  return {_data, _size};
+}
@@ -0,0 +1,40 @@
+#ifndef RASTRUM_MAPPEDFILE_H
+#define RASTRUM_MAPPEDFILE_H
+
+#include <string>
+#include <string_view>
+#include <system_error>
+
+namespace rastrum {
+
+/**
+ * A read only view of a whole file mapped into memory.
+ * The pages are only read from disk as they are touched, so scanning the view costs no more than
+ * reading the file and needs no buffer of its own.
+ */
+class MappedFile {
+ public:
+  /** Maps the file, terminates if it can't be opened. */
+  explicit MappedFile(const std::string& filename);
+
+  /** Maps the file, setting error and leaving the view empty if it can't be opened. */
+  MappedFile(const std::string& filename, std::error_code& error);
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  auto operator=(const MappedFile&) -> MappedFile& = delete;
+
+  /** Gets the contents of the file. */
+  auto data() const -> std::string_view;
+
+ private:
+  /** Maps the file, returning which step failed with errno set for it, or nullptr. */
+  auto map(const std::string& filename) -> const char*;
+
+  const char* _data = nullptr;
+  size_t _size = 0;
+};
+
+}  // namespace rastrum
+
+#endif
@@ -0,0 +1,239 @@
+#include "rastrum/Meshlet.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <optional>
+
+namespace {
+/** Marks a vertex that isn't in the cluster being built. */
+constexpr uint8_t kNotInCluster = std::numeric_limits<uint8_t>::max();
+static_assert(rastrum::Meshlets::kMaxVertices < kNotInCluster,
+              "Cluster vertex indices must fit in a byte");
+
+/** The arrays that make up a model's clusters. */
+struct Clusters {
+  std::vector<rastrum::Meshlet> meshlets;
+  std::vector<uint32_t> vertices;
+  std::vector<uint32_t> faces;
+  std::vector<uint8_t> indices;
+};
+
+/** Fits a bounding sphere and normal cone to a finished cluster. */
+void bound(rastrum::Meshlet& meshlet, const Clusters& clusters,
+           std::span<const rastrum::Vector3DF> vertices,
+           std::span<const rastrum::Vector3DF> normals) {
+  const auto cluster_vertices =
+      std::span(clusters.vertices).subspan(meshlet.vertex_offset, meshlet.vertex_count);
+  const auto cluster_faces =
+      std::span(clusters.faces).subspan(meshlet.face_offset, meshlet.face_count);
+
+  auto min = vertices[cluster_vertices.front()];
+  auto max = min;
+  for (const auto vert : cluster_vertices) {
+    min = rastrum::min(min, vertices[vert]);
+    max = rastrum::max(max, vertices[vert]);
+  }
+
+  const auto sum = min + max;
+  meshlet.center = rastrum::Vector3DF{{sum.x() / 2, sum.y() / 2, sum.z() / 2}};
+  for (const auto vert : cluster_vertices) {
+    meshlet.radius = std::max(meshlet.radius, (vertices[vert] - meshlet.center).length());
+  }
+
+  // Faces with no area have no normal and can never be drawn, so they don't widen the cone
+  rastrum::Vector3DF axis{{0, 0, 0}};
+  for (const auto face : cluster_faces) {
+    axis = axis + normals[face];
+  }
+
+  if (axis.length() == 0) {
+    return;
+  }
+
+  auto& cone = meshlet.cone;
+  cone.axis = axis.normalize();
+  cone.cos_angle = 1;
+  for (const auto face : cluster_faces) {
+    if (normals[face].length() > 0) {
+      cone.cos_angle = std::min(cone.cos_angle, normals[face].dot(cone.axis));
+    }
+  }
+}
+
+template <typename T>
+auto cluster(std::span<const T> indices, std::span<const rastrum::Vector3DF> vertices)
+    -> Clusters {
+  using rastrum::kModelFaceSize;
+  const auto face_count = indices.size() / kModelFaceSize;
+
+  std::vector<rastrum::Vector3DF> normals(face_count);
+  std::vector<rastrum::Vector3DF> centroids(face_count);
+  for (size_t face = 0; face < face_count; ++face) {
+    const auto& a = vertices[indices[face * kModelFaceSize]];
+    const auto& b = vertices[indices[(face * kModelFaceSize) + 1]];
+    const auto& c = vertices[indices[(face * kModelFaceSize) + 2]];
+    normals[face] = (b - a).cross(c - a).normalize();
+    centroids[face] = a + b + c;
+  }
+
+  // The faces using each vertex that are still to be added are kept at the start of its range
+  std::vector<uint32_t> remaining(vertices.size(), 0);
+  for (const auto index : indices) {
+    ++remaining[index];
+  }
+
+  std::vector<uint32_t> first_face(vertices.size() + 1, 0);
+  for (size_t vert = 0; vert < vertices.size(); ++vert) {
+    first_face[vert + 1] = first_face[vert] + remaining[vert];
+  }
+
+  std::vector<uint32_t> vertex_faces(indices.size());
+  std::vector<uint32_t> filled(first_face.begin(), first_face.end() - 1);
+  for (size_t idx = 0; idx < indices.size(); ++idx) {
+    vertex_faces[filled[indices[idx]]++] = static_cast<uint32_t>(idx / kModelFaceSize);
+  }
+
+  Clusters clusters;
+  clusters.vertices.reserve(vertices.size());
+  clusters.faces.reserve(face_count);
+  clusters.indices.reserve(indices.size());
+
+  std::vector<uint8_t> local(vertices.size(), kNotInCluster);
+  std::vector<bool> added(face_count, false);
+  rastrum::Meshlet current;
+  rastrum::Vector3DF centroid_sum{{0, 0, 0}};
+
+  const auto new_vertices = [&](size_t face) {
+    size_t count = 0;
+    for (size_t corner = 0; corner < kModelFaceSize; ++corner) {
+      count += local[indices[(face * kModelFaceSize) + corner]] == kNotInCluster ? 1 : 0;
+    }
+    return count;
+  };
+
+  // Prefers the face adding the fewest vertices, then the one nearest the cluster's centroid
+  const auto best_neighbour = [&]() -> std::optional<uint32_t> {
+    std::optional<uint32_t> best;
+    size_t best_new = kModelFaceSize + 1;
+    float best_distance = 0;
+
+    const auto scale = 1.0F / static_cast<float>(current.face_count);
+    const rastrum::Vector3DF center{
+        {centroid_sum.x() * scale, centroid_sum.y() * scale, centroid_sum.z() * scale}};
+
+    for (size_t idx = 0; idx < current.vertex_count; ++idx) {
+      const auto vert = clusters.vertices[current.vertex_offset + idx];
+      for (auto pos = first_face[vert]; pos < first_face[vert] + remaining[vert]; ++pos) {
+        const auto face = vertex_faces[pos];
+        const auto count = new_vertices(face);
+        const auto offset = centroids[face] - center;
+        const auto distance = offset.dot(offset);
+
+        if (count < best_new || (count == best_new && distance < best_distance)) {
+          best = face;
+          best_new = count;
+          best_distance = distance;
+        }
+      }
+    }
+
+    return best;
+  };
+
+  const auto finish = [&]() {
+    bound(current, clusters, vertices, normals);
+    clusters.meshlets.push_back(current);
+
+    for (size_t idx = 0; idx < current.vertex_count; ++idx) {
+      local[clusters.vertices[current.vertex_offset + idx]] = kNotInCluster;
+    }
+
+    current = rastrum::Meshlet{};
+    current.vertex_offset = static_cast<uint32_t>(clusters.vertices.size());
+    current.face_offset = static_cast<uint32_t>(clusters.faces.size());
+    centroid_sum = rastrum::Vector3DF{{0, 0, 0}};
+  };
+
+  size_t next_unadded = 0;
+  std::optional<uint32_t> seed;
+
+  while (clusters.faces.size() < face_count) {
+    auto face = seed;
+    seed.reset();
+
+    if (current.face_count > 0) {
+      face = best_neighbour();
+      if (!face) {
+        // Nothing left touches the cluster
+        finish();
+        continue;
+      }
+    } else if (!face) {
+      while (added[next_unadded]) {
+        ++next_unadded;
+      }
+      face = static_cast<uint32_t>(next_unadded);
+    }
+
+    // Start the next cluster from the face that didn't fit, so it carries on from this one
+    if (current.vertex_count + new_vertices(*face) > rastrum::Meshlets::kMaxVertices ||
+        current.face_count == rastrum::Meshlets::kMaxFaces) {
+      seed = face;
+      finish();
+      continue;
+    }
+
+    added[*face] = true;
+    for (size_t corner = 0; corner < kModelFaceSize; ++corner) {
+      const auto vert = indices[(*face * kModelFaceSize) + corner];
+      const auto begin = vertex_faces.begin() + first_face[vert];
+      const auto end = begin + remaining[vert];
+      std::iter_swap(std::find(begin, end, *face), end - 1);
+      --remaining[vert];
+
+      if (local[vert] == kNotInCluster) {
+        local[vert] = static_cast<uint8_t>(current.vertex_count++);
+        clusters.vertices.push_back(static_cast<uint32_t>(vert));
+      }
+      clusters.indices.push_back(local[vert]);
+    }
+
+    clusters.faces.push_back(*face);
+    ++current.face_count;
+    centroid_sum = centroid_sum + centroids[*face];
+  }
+
+  if (current.face_count > 0) {
+    finish();
+  }
+
+  return clusters;
+}
+}  // namespace
+
+rastrum::Meshlets::Meshlets(const Model& model) {
+  model.vert_indices().visit([&](auto indices) {
+    auto clusters = cluster(indices, model.vertices());
+    _meshlets = std::move(clusters.meshlets);
+    _vertices = std::move(clusters.vertices);
+    _faces = std::move(clusters.faces);
+    _indices = std::move(clusters.indices);
+  });
+}
+
+auto rastrum::Meshlets::meshlets() const -> std::span<const Meshlet> {
+  return _meshlets;
+}
+
+auto rastrum::Meshlets::vertices() const -> std::span<const uint32_t> {
+  return _vertices;
+}
+
+auto rastrum::Meshlets::faces() const -> std::span<const uint32_t> {
+  return _faces;
+}
+
+auto rastrum::Meshlets::indices() const -> std::span<const uint8_t> {
+  return _indices;
+}
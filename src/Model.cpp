@@ -1,20 +1,334 @@
 #include "rastrum/Model.h"
 
+#include <algorithm>
 #include <iostream>
+#include <limits>
+#include <tuple>
 
-rastrum::Model::Model(std::vector<Vector3DF> vertices, std::vector<size_t> vert_indices)
-    : _vertices(std::move(vertices)), _vert_indices(std::move(vert_indices)) {
+#include "simd.h"
+
+namespace {
+/** Moves values into shared storage, returning a view of them and their owner. */
+template <typename T, typename Allocator>
+auto share(std::vector<T, Allocator> values)
+    -> std::pair<std::span<const T>, std::shared_ptr<const void>> {
+  auto storage = std::make_shared<const std::vector<T, Allocator>>(std::move(values));
+  return {std::span<const T>(*storage), storage};
+}
+
+/**
+ * Copies indices into the narrower type T. Indices too large for T become its max, which is out of
+ * range of any model stored with T so Model::init() still rejects them.
+ */
+template <typename T, typename U>
+auto narrow(const std::vector<U>& indices) -> std::vector<T> {
+  std::vector<T> out(indices.size());
+  std::transform(indices.begin(), indices.end(), out.begin(), [](U index) {
+    return static_cast<T>(std::min<U>(index, std::numeric_limits<T>::max()));
+  });
+  return out;
+}
+
+/** Writes the normal of each face, scaled by twice its area, to normals. */
+void faceNormals(std::span<const rastrum::Vector3DF> vertices, const rastrum::IndexBuffer& indices,
+                 rastrum::Vector3DF* normals) {
+  indices.visit([&](auto face_indices) {
+    const auto face_count = face_indices.size() / rastrum::kModelFaceSize;
+    size_t face = 0;
+
+#if defined(__SSE2__)
+    // Gather a coordinate of one corner of kWidth faces
+    const auto gather = [&](size_t corner, size_t axis) {
+      const auto coord = [&](size_t lane) {
+        return vertices[face_indices[((face + lane) * rastrum::kModelFaceSize) + corner]][axis];
+      };
+      return _mm_setr_ps(coord(0), coord(1), coord(2), coord(3));
+    };
+
+    for (; face + rastrum::simd::kWidth <= face_count; face += rastrum::simd::kWidth) {
+      const __m128 ax = gather(0, 0);
+      const __m128 ay = gather(0, 1);
+      const __m128 az = gather(0, 2);
+      const __m128 ux = _mm_sub_ps(gather(1, 0), ax);
+      const __m128 uy = _mm_sub_ps(gather(1, 1), ay);
+      const __m128 uz = _mm_sub_ps(gather(1, 2), az);
+      const __m128 vx = _mm_sub_ps(gather(2, 0), ax);
+      const __m128 vy = _mm_sub_ps(gather(2, 1), ay);
+      const __m128 vz = _mm_sub_ps(gather(2, 2), az);
+
+      rastrum::simd::store3(normals + face, _mm_sub_ps(_mm_mul_ps(uy, vz), _mm_mul_ps(uz, vy)),
+                            _mm_sub_ps(_mm_mul_ps(uz, vx), _mm_mul_ps(ux, vz)),
+                            _mm_sub_ps(_mm_mul_ps(ux, vy), _mm_mul_ps(uy, vx)));
+    }
+#endif
+
+    for (; face < face_count; ++face) {
+      const auto base = face * rastrum::kModelFaceSize;
+      normals[face] = normal(vertices[face_indices[base]], vertices[face_indices[base + 1]],
+                             vertices[face_indices[base + 2]]);
+    }
+  });
+}
+
+/** Scales each vector to unit length, leaving zero length vectors as zero. */
+void normalize(std::span<rastrum::Vector3DF> vectors) {
+  size_t idx = 0;
+
+#if defined(__SSE2__)
+  for (; idx + rastrum::simd::kWidth <= vectors.size(); idx += rastrum::simd::kWidth) {
+    __m128 x;
+    __m128 y;
+    __m128 z;
+    rastrum::simd::load3(vectors.data() + idx, x, y, z);
+    rastrum::simd::normalize3(x, y, z);
+    rastrum::simd::store3(vectors.data() + idx, x, y, z);
+  }
+#endif
+
+  for (; idx < vectors.size(); ++idx) {
+    vectors[idx] = vectors[idx].normalize();
+  }
+}
+
+/** Finds the bounding box of vertices, and the smallest sphere around its center that fits them. */
+auto bounds(std::span<const rastrum::Vector3DF> vertices) -> rastrum::Bounds {
+  if (vertices.empty()) {
+    return {};
+  }
+
+  auto min = vertices[0];
+  auto max = vertices[0];
+  size_t idx = 0;
+
+#if defined(__SSE2__)
+  // kWidth vertices fill three registers, so keep the minimum and maximum of each register and
+  // pick the coordinates out at the end
+  const auto* floats = reinterpret_cast<const float*>(vertices.data());
+  __m128 min0 = _mm_setr_ps(min.x(), min.y(), min.z(), min.x());
+  __m128 min1 = _mm_setr_ps(min.y(), min.z(), min.x(), min.y());
+  __m128 min2 = _mm_setr_ps(min.z(), min.x(), min.y(), min.z());
+  __m128 max0 = min0;
+  __m128 max1 = min1;
+  __m128 max2 = min2;
+
+  for (; idx + rastrum::simd::kWidth <= vertices.size(); idx += rastrum::simd::kWidth) {
+    const auto* values = floats + (idx * 3);
+    min0 = _mm_min_ps(min0, _mm_loadu_ps(values));
+    min1 = _mm_min_ps(min1, _mm_loadu_ps(values + 4));
+    min2 = _mm_min_ps(min2, _mm_loadu_ps(values + 8));
+    max0 = _mm_max_ps(max0, _mm_loadu_ps(values));
+    max1 = _mm_max_ps(max1, _mm_loadu_ps(values + 4));
+    max2 = _mm_max_ps(max2, _mm_loadu_ps(values + 8));
+  }
+
+  std::array<float, 12> min_lanes{};
+  std::array<float, 12> max_lanes{};
+  _mm_storeu_ps(min_lanes.data(), min0);
+  _mm_storeu_ps(min_lanes.data() + 4, min1);
+  _mm_storeu_ps(min_lanes.data() + 8, min2);
+  _mm_storeu_ps(max_lanes.data(), max0);
+  _mm_storeu_ps(max_lanes.data() + 4, max1);
+  _mm_storeu_ps(max_lanes.data() + 8, max2);
+
+  for (size_t lane = 0; lane < min_lanes.size(); ++lane) {
+    const auto axis = lane % 3;
+    min[axis] = std::min(min[axis], min_lanes[lane]);
+    max[axis] = std::max(max[axis], max_lanes[lane]);
+  }
+#endif
+
+  for (; idx < vertices.size(); ++idx) {
+    min = rastrum::min(min, vertices[idx]);
+    max = rastrum::max(max, vertices[idx]);
+  }
+
+  const float half = 0.5F;
+  const auto center = rastrum::Vector3DF{{(min.x() + max.x()) * half, (min.y() + max.y()) * half,
+                                          (min.z() + max.z()) * half}};
+  float radius_sq = 0;
+  idx = 0;
+
+#if defined(__SSE2__)
+  const __m128 center_x = _mm_set1_ps(center.x());
+  const __m128 center_y = _mm_set1_ps(center.y());
+  const __m128 center_z = _mm_set1_ps(center.z());
+  __m128 max_sq = _mm_setzero_ps();
+
+  for (; idx + rastrum::simd::kWidth <= vertices.size(); idx += rastrum::simd::kWidth) {
+    __m128 x;
+    __m128 y;
+    __m128 z;
+    rastrum::simd::load3(vertices.data() + idx, x, y, z);
+    x = _mm_sub_ps(x, center_x);
+    y = _mm_sub_ps(y, center_y);
+    z = _mm_sub_ps(z, center_z);
+    max_sq = _mm_max_ps(
+        max_sq, _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z)));
+  }
+
+  std::array<float, 4> sq_lanes{};
+  _mm_storeu_ps(sq_lanes.data(), max_sq);
+  radius_sq = *std::max_element(sq_lanes.begin(), sq_lanes.end());
+#endif
+
+  for (; idx < vertices.size(); ++idx) {
+    const auto offset = vertices[idx] - center;
+    radius_sq = std::max(radius_sq, offset.dot(offset));
+  }
+
+  return {min, max, center, std::sqrt(radius_sq)};
+}
+
+/**
+ * Whether indices of type T can address vertex_count vertices, leaving T's max free to stand for
+ * any index too large for T.
+ */
+template <typename T>
+auto fits(size_t vertex_count) -> bool {
+  return vertex_count <= std::numeric_limits<T>::max();
+}
+}  // namespace
+
+auto rastrum::VertexArrays::size() const -> size_t {
+  return x.size();
+}
+
+template <typename T>
+void rastrum::IndexBuffer::assign(std::vector<T> indices) {
+  std::tie(_indices, _storage) = share(std::move(indices));
+}
+
+rastrum::IndexBuffer::IndexBuffer(const std::vector<size_t>& indices, size_t vertex_count) {
+  // Any index >= vertex_count is invalid anyway, so the width only depends on the vertex count
+  if (fits<uint16_t>(vertex_count)) {
+    assign(narrow<uint16_t>(indices));
+  } else if (fits<uint32_t>(vertex_count)) {
+    assign(narrow<uint32_t>(indices));
+  } else {
+    std::cerr << "Models are limited to 2^32 - 1 vertices, received: " << vertex_count << "\n";
+    exit(1);
+  }
+}
+
+rastrum::IndexBuffer::IndexBuffer(std::vector<uint32_t> indices, size_t vertex_count) {
+  if (fits<uint16_t>(vertex_count)) {
+    assign(narrow<uint16_t>(indices));
+  } else {
+    assign(std::move(indices));
+  }
+}
+
+rastrum::IndexBuffer::IndexBuffer(std::vector<uint16_t> indices) {
+  assign(std::move(indices));
+}
+
+rastrum::IndexBuffer::IndexBuffer(std::vector<uint32_t> indices) {
+  assign(std::move(indices));
+}
+
+rastrum::IndexBuffer::IndexBuffer(std::span<const uint16_t> indices,
+                                  std::shared_ptr<const void> storage)
+    : _storage(std::move(storage)), _indices(indices) {
+}
+
+rastrum::IndexBuffer::IndexBuffer(std::span<const uint32_t> indices,
+                                  std::shared_ptr<const void> storage)
+    : _storage(std::move(storage)), _indices(indices) {
+}
+
+auto rastrum::IndexBuffer::operator[](size_t idx) const -> size_t {
+  return visit([idx](auto indices) -> size_t { return indices[idx]; });
+}
+
+auto rastrum::IndexBuffer::begin() const -> Iterator {
+  return {this, 0};
+}
+
+auto rastrum::IndexBuffer::end() const -> Iterator {
+  return {this, size()};
+}
+
+auto rastrum::IndexBuffer::size() const -> size_t {
+  return visit([](auto indices) { return indices.size(); });
+}
+
+auto rastrum::IndexBuffer::width() const -> size_t {
+  return visit([](auto indices) { return sizeof(indices[0]); });
+}
+
+rastrum::Model::Model(std::vector<Vector3DF> vertices, std::vector<size_t> vert_indices,
+                      VertexLayout layout)
+    : _layout(layout), _vert_indices(vert_indices, vertices.size()) {
+  std::tie(_vertices, _storage) = share(std::move(vertices));
+  init();
+}
+
+rastrum::Model::Model(std::vector<Vector3DF> vertices, IndexBuffer vert_indices,
+                      VertexLayout layout)
+    : _layout(layout), _vert_indices(std::move(vert_indices)) {
+  std::tie(_vertices, _storage) = share(std::move(vertices));
+  init();
+}
+
+rastrum::Model::Model(std::span<const Vector3DF> vertices, std::shared_ptr<const void> storage,
+                      IndexBuffer vert_indices, VertexLayout layout)
+    : _storage(std::move(storage)),
+      _vertices(vertices),
+      _layout(layout),
+      _vert_indices(std::move(vert_indices)) {
+  init();
+}
+
+void rastrum::Model::init() {
   if (_vert_indices.size() % kModelFaceSize != 0) {
     std::cerr << "Receive invalid model indices count\n";
     exit(1);
   }
+
+  // The only check of the indices, however they were built
+  const auto vertex_count = _vertices.size();
+  _vert_indices.visit([vertex_count](auto indices) {
+    const auto bad = std::find_if(indices.begin(), indices.end(),
+                                  [vertex_count](auto index) { return index >= vertex_count; });
+    if (bad != indices.end()) {
+      std::cerr << "Model index " << *bad << " is out of range of its " << vertex_count
+                << " vertices\n";
+      exit(1);
+    }
+  });
+
+  if (_layout == VertexLayout::kSoA) {
+    // One allocation holds all three arrays, each padded to keep the next one aligned
+    constexpr size_t kAlignedFloats = kVertexAlignment / sizeof(float);
+    const auto stride = (_vertices.size() + kAlignedFloats - 1) / kAlignedFloats * kAlignedFloats;
+    AlignedFloats arrays(stride * 3);
+
+    for (size_t idx = 0; idx < _vertices.size(); ++idx) {
+      arrays[idx] = _vertices[idx].x();
+      arrays[stride + idx] = _vertices[idx].y();
+      arrays[(stride * 2) + idx] = _vertices[idx].z();
+    }
+
+    const auto [view, storage] = share(std::move(arrays));
+    _array_storage = storage;
+    _vertex_arrays = {view.subspan(0, _vertices.size()), view.subspan(stride, _vertices.size()),
+                      view.subspan(stride * 2, _vertices.size())};
+  }
 }
 
-auto rastrum::Model::vertices() const -> const std::vector<rastrum::Vector3DF>& {
+auto rastrum::Model::vertices() const -> std::span<const rastrum::Vector3DF> {
   return _vertices;
 }
 
-auto rastrum::Model::vert_indices() const -> const std::vector<size_t>& {
+auto rastrum::Model::vertex_arrays() const -> const VertexArrays& {
+  return _vertex_arrays;
+}
+
+auto rastrum::Model::layout() const -> VertexLayout {
+  return _layout;
+}
+
+auto rastrum::Model::vert_indices() const -> const IndexBuffer& {
   return _vert_indices;
 }
 
@@ -32,4 +346,69 @@ auto rastrum::Model::face(size_t idx) const
   const auto base = idx * kModelFaceSize;
   return {_vertices[_vert_indices[base]], _vertices[_vert_indices[base + 1]],
           _vertices[_vert_indices[base + 2]]};
-}
\ No newline at end of file
+}
+
+void rastrum::Model::precompute() {
+  // Face and vertex normals share one allocation
+  std::vector<Vector3DF> normals(face_count() + _vertices.size(), Vector3DF{{0, 0, 0}});
+  const auto face_normals = std::span(normals).subspan(0, face_count());
+  const auto vertex_normals = std::span(normals).subspan(face_count());
+
+  // Sum the area scaled face normals into each vertex before they are normalized
+  faceNormals(_vertices, _vert_indices, face_normals.data());
+  _vert_indices.visit([&](auto indices) {
+    for (size_t idx = 0; idx < indices.size(); ++idx) {
+      auto& vertex_normal = vertex_normals[indices[idx]];
+      vertex_normal = vertex_normal + face_normals[idx / kModelFaceSize];
+    }
+  });
+
+  normalize(normals);
+
+  const Precomputed precomputed{face_normals, vertex_normals, ::bounds(_vertices)};
+  auto [view, storage] = share(std::move(normals));
+  precompute({view.subspan(0, face_count()), view.subspan(face_count()), precomputed.bounds},
+             std::move(storage));
+}
+
+void rastrum::Model::precompute(Precomputed precomputed, std::shared_ptr<const void> storage) {
+  if (precomputed.face_normals.size() != face_count() ||
+      precomputed.vertex_normals.size() != _vertices.size()) {
+    std::cerr << "Received precomputed data for a different model.\n";
+    exit(1);
+  }
+
+  _precomputed = precomputed;
+  _precomputed_storage = std::move(storage);
+}
+
+auto rastrum::Model::precomputed() const -> bool {
+  return _precomputed.has_value();
+}
+
+auto rastrum::Model::face_normals() const -> std::span<const Vector3DF> {
+  if (!_precomputed) {
+    std::cerr << "Attempted to access face normals before Model::precompute().\n";
+    exit(1);
+  }
+
+  return _precomputed->face_normals;
+}
+
+auto rastrum::Model::vertex_normals() const -> std::span<const Vector3DF> {
+  if (!_precomputed) {
+    std::cerr << "Attempted to access vertex normals before Model::precompute().\n";
+    exit(1);
+  }
+
+  return _precomputed->vertex_normals;
+}
+
+auto rastrum::Model::bounds() const -> const Bounds& {
+  if (!_precomputed) {
+    std::cerr << "Attempted to access bounds before Model::precompute().\n";
+    exit(1);
+  }
+
+  return _precomputed->bounds;
+}
@@ -0,0 +1,308 @@
+#include "rastrum/ModelCache.h"
+
+#include <array>
+#include <bit>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <type_traits>
+
+#include "MappedFile.h"
+#include "rastrum/Obj.h"
+#include "rastrum/VertexCache.h"
+
+namespace {
+/** Identifies a cache file. */
+constexpr std::array<char, 8> kMagic{'R', 'A', 'S', 'T', 'R', 'U', 'M', 'C'};
+
+/** Bumped whenever the layout changes, so old caches are rebuilt rather than misread. */
+constexpr uint32_t kVersion = 3;
+
+/** Laid out at the start of a cache file. */
+struct Header {
+  std::array<char, 8> magic;
+  uint32_t version;
+  /** Size in bytes of each index. */
+  uint32_t index_width;
+  /** Whether the model's precomputed data follows the indices. */
+  uint32_t precomputed;
+  /** The ACMR of the source's faces before they were reordered, 0 if unknown. */
+  float source_acmr;
+  rastrum::cache::SourceKey key;
+  uint64_t vertex_count;
+  uint64_t index_count;
+  /** Offsets of each block from the start of the file. */
+  uint64_t vertex_offset;
+  uint64_t index_offset;
+  uint64_t face_normal_offset;
+  uint64_t vertex_normal_offset;
+  rastrum::Bounds bounds;
+  uint64_t file_size;
+  /** Checksum of everything after the header. */
+  uint64_t checksum;
+};
+
+static_assert(std::is_trivially_copyable_v<Header>, "Header is written as raw bytes");
+static_assert(std::is_trivially_copyable_v<rastrum::Vector3DF>, "Vectors are used in place");
+static_assert(sizeof(rastrum::Vector3DF) == 3 * sizeof(float), "Vector3DF is written as raw bytes");
+
+/** Rounds offset up to the next multiple of kVertexAlignment. */
+auto align(uint64_t offset) -> uint64_t {
+  return (offset + rastrum::kVertexAlignment - 1) / rastrum::kVertexAlignment *
+         rastrum::kVertexAlignment;
+}
+
+/**
+ * A fast, non cryptographic checksum for detecting damaged files.
+ * Four independent lanes keep the multiplies from waiting on each other.
+ */
+auto checksum(std::string_view bytes) -> uint64_t {
+  constexpr uint64_t kMul = 0x9E3779B97F4A7C15;
+  constexpr size_t kLanes = 4;
+  std::array<uint64_t, kLanes> lanes{bytes.size(), 1, 2, 3};
+
+  size_t idx = 0;
+  for (; idx + (kLanes * sizeof(uint64_t)) <= bytes.size(); idx += kLanes * sizeof(uint64_t)) {
+    for (size_t lane = 0; lane < kLanes; ++lane) {
+      uint64_t word = 0;
+      std::memcpy(&word, bytes.data() + idx + (lane * sizeof(uint64_t)), sizeof(word));
+      lanes[lane] = std::rotl(lanes[lane] ^ word, 31) * kMul;
+    }
+  }
+
+  uint64_t hash = 0;
+  for (const auto lane : lanes) {
+    hash = std::rotl(hash ^ lane, 31) * kMul;
+  }
+  for (; idx < bytes.size(); ++idx) {
+    hash = (hash ^ static_cast<unsigned char>(bytes[idx])) * kMul;
+  }
+
+  return hash;
+}
+
+/** Checks that count elements of T at offset lie inside a file of size bytes. */
+template <typename T>
+auto inFile(uint64_t offset, uint64_t count, uint64_t size) -> bool {
+  return offset % rastrum::kVertexAlignment == 0 && offset <= size &&
+         count <= (size - offset) / sizeof(T);
+}
+
+/** Views the index block of a mapped cache, returning nothing if it is invalid. */
+template <typename T>
+auto viewIndices(const Header& header, const std::shared_ptr<const rastrum::MappedFile>& file)
+    -> std::optional<rastrum::IndexBuffer> {
+  const auto data = file->data();
+  if (!inFile<T>(header.index_offset, header.index_count, data.size())) {
+    return std::nullopt;
+  }
+
+  // Indices are checked against the vertices by the Model they are loaded into
+  const std::span indices(reinterpret_cast<const T*>(data.data() + header.index_offset),
+                          header.index_count);
+  return rastrum::IndexBuffer(indices, file);
+}
+}  // namespace
+
+auto rastrum::cache::sourceKey(const std::string& filename) -> SourceKey {
+  std::error_code error;
+  const auto size = std::filesystem::file_size(filename, error);
+  const auto mtime = std::filesystem::last_write_time(filename, error);
+
+  if (error) {
+    return {};
+  }
+
+  return {size, static_cast<int64_t>(mtime.time_since_epoch().count())};
+}
+
+auto rastrum::cache::save(const Model& model, const std::string& filename, SourceKey key,
+                          float source_acmr) -> bool {
+  const auto vertices = model.vertices();
+  const auto& indices = model.vert_indices();
+
+  Header header{};
+  header.magic = kMagic;
+  header.version = kVersion;
+  header.index_width = static_cast<uint32_t>(indices.width());
+  header.source_acmr = source_acmr;
+  header.key = key;
+  header.vertex_count = vertices.size();
+  header.index_count = indices.size();
+  header.vertex_offset = align(sizeof(Header));
+  header.index_offset = align(header.vertex_offset + vertices.size_bytes());
+  header.file_size = header.index_offset + (indices.size() * indices.width());
+
+  if (model.precomputed()) {
+    header.precomputed = 1;
+    header.face_normal_offset = align(header.file_size);
+    header.vertex_normal_offset =
+        align(header.face_normal_offset + model.face_normals().size_bytes());
+    header.bounds = model.bounds();
+    header.file_size = header.vertex_normal_offset + model.vertex_normals().size_bytes();
+  }
+
+  // Write to a temporary file and move it into place, so a reader never sees half a cache
+  const auto temp_filename = filename + ".tmp";
+  const auto fail = [&] {
+    std::cerr << "Failed to write model cache: " << filename << "\n";
+    std::error_code error;
+    std::filesystem::remove(temp_filename, error);
+    return false;
+  };
+
+  bool good = false;
+  {
+    std::ofstream file(temp_filename, std::ios::binary | std::ios::trunc);
+    const auto pad = [&](uint64_t offset) {
+      while (static_cast<uint64_t>(file.tellp()) < offset) {
+        file.put(0);
+      }
+    };
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    pad(header.vertex_offset);
+    file.write(reinterpret_cast<const char*>(vertices.data()),
+               static_cast<std::streamsize>(vertices.size_bytes()));
+    pad(header.index_offset);
+    indices.visit([&](auto data) {
+      file.write(reinterpret_cast<const char*>(data.data()),
+                 static_cast<std::streamsize>(data.size_bytes()));
+    });
+
+    if (model.precomputed()) {
+      pad(header.face_normal_offset);
+      file.write(reinterpret_cast<const char*>(model.face_normals().data()),
+                 static_cast<std::streamsize>(model.face_normals().size_bytes()));
+      pad(header.vertex_normal_offset);
+      file.write(reinterpret_cast<const char*>(model.vertex_normals().data()),
+                 static_cast<std::streamsize>(model.vertex_normals().size_bytes()));
+    }
+
+    good = file.good();
+  }
+  if (!good) {
+    return fail();
+  }
+
+  // Checksum what was written, then fill it in
+  {
+    std::error_code error;
+    const MappedFile written(temp_filename, error);
+    if (error) {
+      return fail();
+    }
+    header.checksum = checksum(written.data().substr(sizeof(Header)));
+  }
+  {
+    std::fstream file(temp_filename, std::ios::binary | std::ios::in | std::ios::out);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    good = file.good();
+  }
+  if (!good) {
+    return fail();
+  }
+
+  std::error_code error;
+  std::filesystem::rename(temp_filename, filename, error);
+  if (error) {
+    return fail();
+  }
+
+  return true;
+}
+
+auto rastrum::cache::load(const std::string& filename, std::optional<SourceKey> key,
+                          VertexLayout layout, float* source_acmr) -> std::optional<Model> {
+  std::error_code error;
+  if (!std::filesystem::is_regular_file(filename, error)) {
+    return std::nullopt;
+  }
+
+  auto file = std::make_shared<const MappedFile>(filename, error);
+  if (error) {
+    return std::nullopt;
+  }
+
+  const auto data = file->data();
+  if (data.size() < sizeof(Header)) {
+    return std::nullopt;
+  }
+
+  Header header{};
+  std::memcpy(&header, data.data(), sizeof(header));
+
+  // A stale cache is rejected from its header alone, only the header's pages have been read
+  if (header.magic != kMagic || header.version != kVersion || header.file_size != data.size() ||
+      (key && header.key != *key)) {
+    return std::nullopt;
+  }
+
+  // The key matches, so reading the whole file to check it's intact is worth it
+  if (header.index_count % kModelFaceSize != 0 ||
+      !inFile<Vector3DF>(header.vertex_offset, header.vertex_count, data.size()) ||
+      checksum(data.substr(sizeof(Header))) != header.checksum) {
+    return std::nullopt;
+  }
+
+  const std::span vertices(reinterpret_cast<const Vector3DF*>(data.data() + header.vertex_offset),
+                           header.vertex_count);
+
+  std::optional<IndexBuffer> indices;
+  if (header.index_width == sizeof(uint16_t)) {
+    indices = viewIndices<uint16_t>(header, file);
+  } else if (header.index_width == sizeof(uint32_t)) {
+    indices = viewIndices<uint32_t>(header, file);
+  }
+
+  if (!indices) {
+    return std::nullopt;
+  }
+
+  Model model(vertices, file, *indices, layout);
+
+  if (header.precomputed != 0) {
+    const auto face_count = header.index_count / kModelFaceSize;
+    if (!inFile<Vector3DF>(header.face_normal_offset, face_count, data.size()) ||
+        !inFile<Vector3DF>(header.vertex_normal_offset, header.vertex_count, data.size())) {
+      return std::nullopt;
+    }
+
+    const auto view = [&](uint64_t offset, uint64_t count) {
+      return std::span(reinterpret_cast<const Vector3DF*>(data.data() + offset), count);
+    };
+    model.precompute({view(header.face_normal_offset, face_count),
+                      view(header.vertex_normal_offset, header.vertex_count), header.bounds},
+                     file);
+  }
+
+  if (source_acmr != nullptr) {
+    *source_acmr = header.source_acmr;
+  }
+
+  return model;
+}
+
+auto rastrum::cache::loadObj(const std::string& filename, VertexLayout layout, size_t threads,
+                             float* source_acmr) -> Model {
+  const auto cache_filename = filename + ".cache";
+  const auto key = sourceKey(filename);
+
+  if (auto cached = load(cache_filename, key, layout, source_acmr)) {
+    return *std::move(cached);
+  }
+
+  // Measured now as the source's own face order is gone once the cache is written
+  const auto source = obj::load(filename, layout, threads);
+  const auto file_acmr = acmr(source);
+  if (source_acmr != nullptr) {
+    *source_acmr = file_acmr;
+  }
+
+  auto model = optimizeVertexCache(source);
+  model.precompute();
+  save(model, cache_filename, key, file_acmr);
+  return model;
+}
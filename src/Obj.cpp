@@ -1,103 +1,484 @@
 #include "rastrum/Obj.h"
 
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <chrono>
+#include <charconv>
+#include <cstdint>
 #include <fstream>
+#include <future>
 #include <iostream>
+#include <limits>
+#include <memory>
+#include <optional>
 #include <string_view>
+#include <utility>
 #include <vector>
 
+#include "MappedFile.h"
+#include "mesh.h"
+#include "parallel.h"
 #include "rastrum/Vector.h"
 
+/** Shared between a load and the LoadHandle tracking it. */
+struct rastrum::obj::LoadProgress {
+  std::atomic<size_t> bytes_loaded = 0;
+  std::atomic<size_t> bytes_total = 0;
+  std::atomic<bool> cancelled = false;
+};
+
 namespace {
+/** Separates the fields of a record, '\r' is included so files with CRLF endings parse. */
+auto isSpace(char chr) -> bool {
+  return chr == ' ' || chr == '\t' || chr == '\r';
+}
+
+void skipSpaces(std::string_view& line) {
+  while (!line.empty() && isSpace(line.front())) {
+    line.remove_prefix(1);
+  }
+}
+
+/** Removes the next line from text and returns it without its '\n'. */
+auto nextLine(std::string_view& text) -> std::string_view {
+  const auto end = text.find('\n');
+  const auto line = text.substr(0, end);
+  text.remove_prefix(end == std::string_view::npos ? text.size() : end + 1);
+  return line;
+}
+
+/** Parses the next field of line as a number, returning false if it isn't one. */
+template <typename T>
+auto parseField(std::string_view& line, T& value) -> bool {
+  skipSpaces(line);
+
+  // from_chars doesn't accept an explicit plus sign
+  if (!line.empty() && line.front() == '+') {
+    line.remove_prefix(1);
+  }
+
+  const auto [end, error] = std::from_chars(line.data(), line.data() + line.size(), value);
+  if (error != std::errc{}) {
+    return false;
+  }
+
+  line.remove_prefix(end - line.data());
+  return true;
+}
+
+/** Skips the optional texture and normal indices after a face's vertex index. */
+auto skipAttributes(std::string_view& fields) -> bool {
+  int64_t index = 0;
+
+  for (size_t attribute = 0; attribute < 2; ++attribute) {
+    if (fields.empty() || fields.front() != '/') {
+      return true;
+    }
+    fields.remove_prefix(1);
+
+    // The texture index may be left out, as in v//vn
+    const bool optional = attribute == 0 && !fields.empty() && fields.front() == '/';
+    if (!optional && (fields.empty() || isSpace(fields.front()) || !parseField(fields, index))) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/** A polygon that was written as a fan and needs triangulating properly. */
+struct Polygon {
+  size_t first_index;
+  size_t sides;
+};
+
+/** A run of whole lines of the file that is parsed independently of the others. */
+struct Chunk {
+  std::string_view text;
+  size_t vertex_count = 0;
+  /** The number of indices the chunk's faces make once they are split into triangles. */
+  size_t index_count = 0;
+  /** Where the chunk's records go in the model, the sums of the counts of earlier chunks. */
+  size_t first_vertex = 0;
+  size_t first_index = 0;
+  /** The largest index read from the chunk. */
+  uint32_t max_index = 0;
+  /** Faces with more than three sides. */
+  std::vector<Polygon> polygons{};
+};
+
+/** Smallest chunk worth handing to a worker. */
+constexpr size_t kMinChunkSize = size_t{1} << 20;
+
+/** Largest chunk, so progress is reported and cancellation is noticed regularly. */
+constexpr size_t kMaxChunkSize = size_t{1} << 23;
+
+/** Chunks per worker, so a worker that is given sparse lines doesn't sit idle. */
+constexpr size_t kChunksPerThread = 4;
+
+/** Splits text into chunks of roughly equal size that end on line boundaries. */
+auto split(std::string_view text, size_t threads) -> std::vector<Chunk> {
+  const auto target = std::clamp(text.size() / (threads * kChunksPerThread), kMinChunkSize,
+                                 kMaxChunkSize);
+  std::vector<Chunk> chunks;
+
+  while (!text.empty()) {
+    auto end = text.size() <= target ? std::string_view::npos : text.find('\n', target);
+    end = end == std::string_view::npos ? text.size() : end + 1;
+
+    chunks.push_back({.text = text.substr(0, end)});
+    text.remove_prefix(end);
+  }
+
+  return chunks;
+}
+
+/** Counts the vertex and face records in a chunk so its place in the model is known. */
+void countRecords(Chunk& chunk) {
+  auto text = chunk.text;
+
+  while (!text.empty()) {
+    auto line = nextLine(text);
+
+    if (line.starts_with("v ")) {
+      ++chunk.vertex_count;
+    } else if (line.starts_with("f ")) {
+      line.remove_prefix(2);
+
+      size_t sides = 0;
+      for (skipSpaces(line); !line.empty(); skipSpaces(line)) {
+        ++sides;
+        while (!line.empty() && !isSpace(line.front())) {
+          line.remove_prefix(1);
+        }
+      }
+
+      // A polygon splits into sides - 2 triangles, anything smaller is rejected when parsed
+      if (sides >= rastrum::kModelFaceSize) {
+        chunk.index_count += (sides - 2) * rastrum::kModelFaceSize;
+      }
+    }
+  }
+}
+
+/** Parses the fields of a vertex record, after the "v ". */
+auto parseVertex(std::string_view line, std::string_view fields) -> rastrum::Vector3DF {
+  // We ignore everything after X Y Z
+  std::array<float, 3> vert{0, 0, 0};
+  for (auto& coord : vert) {
+    if (!parseField(fields, coord)) {
+      skipSpaces(fields);
+      std::string message = fields.empty() ? "Failed to parse vertex line(not enough fields): "
+                                           : "Failed to parse vertex line (bad vertex): ";
+      throw rastrum::obj::LoadError(message.append(line));
+    }
+  }
+
+  return rastrum::Vector3DF{{vert[0], vert[1], vert[2]}};
+}
+
+/**
+ * Parses the fields of a face record, after the "f ", into the indices of its vertices.
+ * vertex_count is the number of vertices before the face, which negative indices count back from.
+ */
+void parseFace(std::string_view line, std::string_view fields, size_t vertex_count,
+               std::vector<uint32_t>& face) {
+  // v, v/vt, v//vn or v/vt/vn for each vertex, only the vertex is used
+  face.clear();
+
+  int64_t index = 0;
+  while (parseField(fields, index)) {
+    // Obj indices are 1 based, negative indices count back from the last vertex
+    const auto resolved = index > 0 ? index - 1 : static_cast<int64_t>(vertex_count) + index;
+    if (index == 0 || resolved < 0 || resolved > std::numeric_limits<uint32_t>::max() ||
+        !skipAttributes(fields) || (!fields.empty() && !isSpace(fields.front()))) {
+      break;
+    }
+
+    face.push_back(static_cast<uint32_t>(resolved));
+  }
+
+  skipSpaces(fields);
+  if (!fields.empty()) {
+    throw rastrum::obj::LoadError(
+        std::string("Failed to parse face line (bad index): ").append(line));
+  }
+
+  if (face.size() < rastrum::kModelFaceSize) {
+    throw rastrum::obj::LoadError("Tried to load model with " + std::to_string(face.size()) +
+                                  " sided face (Faces need at least 3 sides).");
+  }
+}
+
+/** Writes a face's vertices to out as a fan of triangles, returning the end of the written ones. */
+auto writeFan(const std::vector<uint32_t>& face, uint32_t* out) -> uint32_t* {
+  for (size_t side = 1; side + 1 < face.size(); ++side) {
+    *out++ = face[0];
+    *out++ = face[side];
+    *out++ = face[side + 1];
+  }
+
+  return out;
+}
+
 /**
- * Splits a string_view into a vector of string_views.
- * It seems you actually need to be using C++23 and the trunk of gcc to do anything useful
- * with std::views::split.
+ * Parses the records of a chunk into its place in vertices and vert_indices.
+ * Polygons are written as a fan, which may be wrong for concave ones, and recorded so they can be
+ * triangulated once every vertex has been read.
  */
-auto split(std::string_view strv, std::string_view delims) -> std::vector<std::string_view> {
-  std::vector<std::string_view> output;
-  size_t first = 0;
+void parseChunk(Chunk& chunk, rastrum::Vector3DF* vertices, uint32_t* vert_indices) {
+  auto text = chunk.text;
+  auto vertex_idx = chunk.first_vertex;
+  auto* out = vert_indices + chunk.first_index;
+  std::vector<uint32_t> face;
 
-  while (first < strv.size()) {
-    const auto second = strv.find_first_of(delims, first);
+  while (!text.empty()) {
+    const auto line = nextLine(text);
 
-    if (first != second) {
-      output.emplace_back(strv.substr(first, second - first));
+    if (line.starts_with("v ")) {
+      vertices[vertex_idx++] = parseVertex(line, line.substr(2));
+    } else if (line.starts_with("f ")) {
+      parseFace(line, line.substr(2), vertex_idx, face);
+
+      if (face.size() > rastrum::kModelFaceSize) {
+        chunk.polygons.push_back({static_cast<size_t>(out - vert_indices), face.size()});
+      }
+
+      chunk.max_index = std::max(chunk.max_index, *std::max_element(face.begin(), face.end()));
+      out = writeFan(face, out);
     }
+  }
+}
 
-    if (second == std::string_view::npos) {
-      break;
+/** Calls fn, terminating with the message of any LoadError as the synchronous loaders do. */
+template <typename F>
+auto orExit(F&& fn) -> decltype(auto) {
+  try {
+    return fn();
+  } catch (const rastrum::obj::LoadError& error) {
+    std::cerr << error.what() << "\n";
+    exit(1);
+  }
+}
+
+/**
+ * Loads a model, see obj::load, returning nothing if it is cancelled through progress. Throws
+ * LoadError if the file can't be opened or has an error.
+ */
+auto loadModel(const std::string& filename, rastrum::VertexLayout layout, size_t threads,
+               rastrum::obj::LoadProgress& progress) -> std::optional<rastrum::Model> {
+  using rastrum::Vector3DF;
+  using rastrum::parallel::forEach;
+
+  threads = threads == 0 ? rastrum::parallel::defaultThreads() : threads;
+
+  std::error_code error;
+  const rastrum::MappedFile file(filename, error);
+  if (error) {
+    throw rastrum::obj::LoadError("Failed to open: " + filename + " (" + error.message() + ")");
+  }
+  progress.bytes_total = file.data().size();
+  auto chunks = split(file.data(), threads);
+
+  // Count every chunk's records then lay the chunks out one after another, so each can be parsed
+  // straight into its place in the model and knows how many vertices come before it
+  forEach(chunks.size(), threads, [&](size_t chunk_idx) {
+    if (!progress.cancelled) {
+      countRecords(chunks[chunk_idx]);
+    }
+  });
+
+  size_t vertex_count = 0;
+  size_t index_count = 0;
+  for (auto& chunk : chunks) {
+    chunk.first_vertex = vertex_count;
+    chunk.first_index = index_count;
+    vertex_count += chunk.vertex_count;
+    index_count += chunk.index_count;
+  }
+
+  if (vertex_count > std::numeric_limits<uint32_t>::max()) {
+    throw rastrum::obj::LoadError("Obj contains too many vertices: " +
+                                  std::to_string(vertex_count));
+  }
+
+  std::vector<Vector3DF> vertices(vertex_count);
+  std::vector<uint32_t> vert_indices(index_count);
+  forEach(chunks.size(), threads, [&](size_t chunk_idx) {
+    if (!progress.cancelled) {
+      parseChunk(chunks[chunk_idx], vertices.data(), vert_indices.data());
+      progress.bytes_loaded += chunks[chunk_idx].text.size();
     }
+  });
+
+  if (progress.cancelled) {
+    return std::nullopt;
+  }
+
+  uint32_t max_index = 0;
+  for (const auto& chunk : chunks) {
+    max_index = std::max(max_index, chunk.max_index);
+  }
 
-    first = second + 1;
+  if (!vert_indices.empty() && max_index >= vertices.size()) {
+    throw rastrum::obj::LoadError("Obj contains indices to verts that don't exist: max_index: " +
+                                  std::to_string(max_index) +
+                                  ", vertices.size(): " + std::to_string(vertices.size()));
   }
 
-  return output;
+  // Now every vertex is known, replace the fans of any polygons with proper triangulations
+  forEach(chunks.size(), threads, [&](size_t chunk_idx) {
+    for (const auto& polygon : chunks[chunk_idx].polygons) {
+      rastrum::mesh::triangulate(vert_indices.data() + polygon.first_index, polygon.sides,
+                                 vertices.data());
+    }
+  });
+
+  rastrum::mesh::weld(vertices, vert_indices, threads);
+
+  const auto unique_count = vertices.size();
+  return rastrum::Model(std::move(vertices),
+                        rastrum::IndexBuffer(std::move(vert_indices), unique_count), layout);
 }
 }  // namespace
 
-auto rastrum::obj::load(const std::string& filename) -> rastrum::Model {
-  std::vector<Vector3DF> vertices;
-  std::vector<size_t> vert_indices;
-  size_t max_index = 0;
+auto rastrum::obj::load(const std::string& filename, VertexLayout layout, size_t threads)
+    -> rastrum::Model {
+  LoadProgress progress;
+  return *orExit([&]() { return loadModel(filename, layout, threads, progress); });
+}
+
+auto rastrum::obj::loadAsync(const std::string& filename, VertexLayout layout, size_t threads)
+    -> LoadHandle {
+  auto progress = std::make_shared<LoadProgress>();
+  auto model = std::async(std::launch::async, [=]() {
+    return loadModel(filename, layout, threads, *progress);
+  });
+
+  return LoadHandle(std::move(model), progress);
+}
 
-  std::ifstream file(filename);
+rastrum::obj::LoadHandle::LoadHandle(std::future<std::optional<Model>> model,
+                                     std::shared_ptr<LoadProgress> progress)
+    : _progress(std::move(progress)), _model(std::move(model)) {
+}
+
+rastrum::obj::LoadHandle::~LoadHandle() {
+  // Don't keep loading a model no one can collect, the future waits for the load to stop
+  if (_model.valid()) {
+    cancel();
+  }
+}
+
+auto rastrum::obj::LoadHandle::operator=(LoadHandle&& other) noexcept -> LoadHandle& {
+  if (this != &other) {
+    // Don't leave the replaced load running unseen, the wait can't throw as nothing is collected
+    if (_model.valid()) {
+      cancel();
+      _model.wait();
+    }
+    _progress = std::move(other._progress);
+    _model = std::move(other._model);
+  }
+  return *this;
+}
+
+auto rastrum::obj::LoadHandle::get() -> std::optional<Model> {
+  return _model.get();
+}
+
+auto rastrum::obj::LoadHandle::ready() const -> bool {
+  return _model.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+auto rastrum::obj::LoadHandle::bytesLoaded() const -> size_t {
+  return _progress->bytes_loaded;
+}
+
+auto rastrum::obj::LoadHandle::bytesTotal() const -> size_t {
+  return _progress->bytes_total;
+}
+
+void rastrum::obj::LoadHandle::cancel() {
+  _progress->cancelled = true;
+}
+
+void rastrum::obj::stream(const std::string& filename, const StreamHandler& handler,
+                          size_t chunk_size) {
+  std::ifstream file(filename, std::ios::binary);
   if (!file.good()) {
     std::cerr << "Failed to open: " << filename << "\n";
+    exit(1);
   }
 
-  std::string line;
-  while (std::getline(file, line)) {
-    auto line_view = std::string_view(line);
+  std::vector<char> buffer(std::max<size_t>(chunk_size, 1));
+  std::vector<uint32_t> batch;
+  batch.reserve(kStreamFaceBatch * kModelFaceSize);
+  std::vector<uint32_t> face;
+  size_t vertex_count = 0;
 
-    if (line_view.starts_with("#")) {
-      // Comment - ignore
-    } else if (line_view.starts_with("v ")) {
-      // Vertex - we ignore everything after X Y Z
-      line_view.remove_prefix(2);
+  const auto flush = [&]() {
+    if (!batch.empty() && handler.faces) {
+      handler.faces(batch);
+    }
+    batch.clear();
+  };
 
-      const auto segments = split(line_view, " ");
-      if (segments.size() < 3) {
-        std::cerr << "Failed to parse vertex line(not enough fields): " << line << "\n";
-        exit(1);
+  const auto parseLine = [&](std::string_view line) {
+    if (line.starts_with("v ")) {
+      const auto vertex = parseVertex(line, line.substr(2));
+      if (handler.vertex) {
+        handler.vertex(vertex_count, vertex);
       }
+      ++vertex_count;
+    } else if (line.starts_with("f ")) {
+      parseFace(line, line.substr(2), vertex_count, face);
 
-      std::array<float, 3> vert{0, 0, 0};
-      for (size_t field_idx = 0; field_idx < 3; ++field_idx) {
-        try {
-          vert[field_idx] = std::stof(segments[field_idx].data());
-        } catch (std::invalid_argument&) {
-          std::cerr << "Failed to parse vertex line (bad vertex): " << line << "\n";
-          exit(1);
-        }
+      if (*std::max_element(face.begin(), face.end()) >= vertex_count) {
+        std::cerr << "Obj face uses a vertex that hasn't been read yet: " << line << "\n";
+        exit(1);
       }
 
-      vertices.push_back(Vector3DF{{vert[0], vert[1], vert[2]}});
-    } else if (line_view.starts_with("f ")) {
-      // Face - we only support triangles
-      line_view.remove_prefix(2);
+      const auto size = batch.size();
+      batch.resize(size + ((face.size() - 2) * kModelFaceSize));
+      writeFan(face, batch.data() + size);
 
-      const auto segments = split(line_view, " ");
-      if (segments.size() != 3) {
-        std::cerr << "Tried to load model with " << segments.size()
-                  << "sided face (Only 3 sided faces are supported).\n";
-        exit(1);
+      if (batch.size() >= kStreamFaceBatch * kModelFaceSize) {
+        flush();
       }
+    }
+  };
 
-      for (const auto element : segments) {
-        const size_t index = std::stoul(element.data()) - 1;  // Obj indices are 1 based
-        max_index = std::max(max_index, index);
-        vert_indices.push_back(index);
-      }
+  size_t filled = 0;
+  bool done = false;
+  while (!done) {
+    file.read(buffer.data() + filled, static_cast<std::streamsize>(buffer.size() - filled));
+    filled += static_cast<size_t>(file.gcount());
+    done = !file;
+
+    // Only parse whole lines, the last partial one is kept for the next read
+    auto text = std::string_view(buffer.data(), filled);
+    const auto last_line = text.rfind('\n');
+    const auto end = done ? filled : (last_line == std::string_view::npos ? 0 : last_line + 1);
+
+    if (end == 0 && !done) {
+      // A single line fills the buffer, make room for the rest of it
+      buffer.resize(buffer.size() * 2);
+      continue;
     }
-  }
 
-  if (max_index >= vertices.size()) {
-    std::cerr << "Obj contains indices to verts that don't exist: "
-              << "max_index: " << max_index << ", "
-              << "vertices.size(): " << vertices.size() << "\n";
-    exit(1);
+    text = text.substr(0, end);
+    orExit([&]() {
+      while (!text.empty()) {
+        parseLine(nextLine(text));
+      }
+    });
+
+    std::copy(buffer.begin() + static_cast<std::ptrdiff_t>(end),
+              buffer.begin() + static_cast<std::ptrdiff_t>(filled), buffer.begin());
+    filled -= end;
   }
 
-  return Model(vertices, vert_indices);
-}
\ No newline at end of file
+  flush();
+}
@@ -0,0 +1,426 @@
+#include "rastrum/Ply.h"
+
+#include <array>
+#include <bit>
+#include <charconv>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "MappedFile.h"
+#include "binary.h"
+#include "mesh.h"
+#include "parallel.h"
+
+namespace {
+/** The number types a property can have. */
+enum class Type { kInt8, kUInt8, kInt16, kUInt16, kInt32, kUInt32, kFloat32, kFloat64 };
+
+/** Gets a type from its name in the header, PLY has two names for most types. */
+auto parseType(std::string_view name) -> std::optional<Type> {
+  constexpr std::array<std::pair<std::string_view, Type>, 16> kNames{{
+      {"char", Type::kInt8},     {"int8", Type::kInt8},       {"uchar", Type::kUInt8},
+      {"uint8", Type::kUInt8},   {"short", Type::kInt16},     {"int16", Type::kInt16},
+      {"ushort", Type::kUInt16}, {"uint16", Type::kUInt16},   {"int", Type::kInt32},
+      {"int32", Type::kInt32},   {"uint", Type::kUInt32},     {"uint32", Type::kUInt32},
+      {"float", Type::kFloat32}, {"float32", Type::kFloat32}, {"double", Type::kFloat64},
+      {"float64", Type::kFloat64},
+  }};
+
+  for (const auto& [type_name, type] : kNames) {
+    if (type_name == name) {
+      return type;
+    }
+  }
+  return std::nullopt;
+}
+
+auto typeSize(Type type) -> size_t {
+  switch (type) {
+    case Type::kInt8:
+    case Type::kUInt8:
+      return 1;
+    case Type::kInt16:
+    case Type::kUInt16:
+      return 2;
+    case Type::kInt32:
+    case Type::kUInt32:
+    case Type::kFloat32:
+      return 4;
+    case Type::kFloat64:
+      return 8;
+  }
+  return 0;
+}
+
+/** Reads a value of the given type at data and converts it to a T. */
+template <typename T>
+auto readAs(const char* data, Type type, std::endian order) -> T {
+  using rastrum::binary::read;
+
+  switch (type) {
+    case Type::kInt8:
+      return static_cast<T>(read<int8_t>(data, order));
+    case Type::kUInt8:
+      return static_cast<T>(read<uint8_t>(data, order));
+    case Type::kInt16:
+      return static_cast<T>(read<int16_t>(data, order));
+    case Type::kUInt16:
+      return static_cast<T>(read<uint16_t>(data, order));
+    case Type::kInt32:
+      return static_cast<T>(read<int32_t>(data, order));
+    case Type::kUInt32:
+      return static_cast<T>(read<uint32_t>(data, order));
+    case Type::kFloat32:
+      return static_cast<T>(read<float>(data, order));
+    case Type::kFloat64:
+      return static_cast<T>(read<double>(data, order));
+  }
+  return T{};
+}
+
+struct Property {
+  std::string_view name;
+  /** The type of the value, or of each item if it is a list. */
+  Type type = Type::kFloat32;
+  /** The type of the number of items in a list, nothing if the property isn't a list. */
+  std::optional<Type> count_type;
+};
+
+struct Element {
+  std::string_view name;
+  size_t count = 0;
+  std::vector<Property> properties;
+
+  /** The size of each item, nothing if it has lists so the size varies. */
+  auto stride() const -> std::optional<size_t> {
+    size_t res = 0;
+    for (const auto& property : properties) {
+      if (property.count_type) {
+        return std::nullopt;
+      }
+      res += typeSize(property.type);
+    }
+    return res;
+  }
+
+  /** The index of the property called name. */
+  auto find(std::string_view property_name) const -> std::optional<size_t> {
+    for (size_t idx = 0; idx < properties.size(); ++idx) {
+      if (properties[idx].name == property_name) {
+        return idx;
+      }
+    }
+    return std::nullopt;
+  }
+};
+
+struct Header {
+  std::endian order = std::endian::little;
+  std::vector<Element> elements;
+  /** The size of the header in bytes, the data starts straight after it. */
+  size_t size = 0;
+};
+
+/** Starts a polygon's triangles in vert_indices, see mesh::triangulate. */
+struct Polygon {
+  size_t first_index;
+  size_t sides;
+};
+
+/** The number of vertices each worker reads at a time. */
+constexpr size_t kBlockVertices = size_t{1} << 16;
+
+void fail(std::string_view message, const std::string& filename) {
+  std::cerr << message << filename << "\n";
+  exit(1);
+}
+
+/** Removes the next line from text and returns it without its line ending. */
+auto nextLine(std::string_view& text) -> std::string_view {
+  const auto end = text.find('\n');
+  auto line = text.substr(0, end);
+  text.remove_prefix(end == std::string_view::npos ? text.size() : end + 1);
+  if (line.ends_with('\r')) {
+    line.remove_suffix(1);
+  }
+  return line;
+}
+
+/** Removes the next space separated word from line and returns it. */
+auto nextWord(std::string_view& line) -> std::string_view {
+  const auto start = std::min(line.find_first_not_of(' '), line.size());
+  line.remove_prefix(start);
+  const auto end = std::min(line.find(' '), line.size());
+  const auto word = line.substr(0, end);
+  line.remove_prefix(end);
+  return word;
+}
+
+auto parseHeader(std::string_view contents, const std::string& filename) -> Header {
+  Header header;
+  bool has_format = false;
+  auto text = contents;
+
+  if (nextLine(text) != "ply") {
+    fail("Not a PLY file: ", filename);
+  }
+
+  while (true) {
+    if (text.empty()) {
+      fail("PLY header has no end_header: ", filename);
+    }
+
+    auto line = nextLine(text);
+    const auto keyword = nextWord(line);
+
+    if (keyword == "format") {
+      const auto format = nextWord(line);
+      if (format == "binary_little_endian") {
+        header.order = std::endian::little;
+      } else if (format == "binary_big_endian") {
+        header.order = std::endian::big;
+      } else if (format == "ascii") {
+        fail("Only binary PLY files are supported: ", filename);
+      } else {
+        fail("PLY file has an unknown format: ", filename);
+      }
+      has_format = true;
+    } else if (keyword == "element") {
+      Element element;
+      element.name = nextWord(line);
+      const auto count = nextWord(line);
+      const auto [end, error] =
+          std::from_chars(count.data(), count.data() + count.size(), element.count);
+      if (error != std::errc{} || end != count.data() + count.size()) {
+        fail("PLY element has a bad count: ", filename);
+      }
+      header.elements.push_back(std::move(element));
+    } else if (keyword == "property") {
+      if (header.elements.empty()) {
+        fail("PLY property comes before any element: ", filename);
+      }
+
+      Property property;
+      auto type_name = nextWord(line);
+      if (type_name == "list") {
+        property.count_type = parseType(nextWord(line));
+        type_name = nextWord(line);
+        if (!property.count_type) {
+          fail("PLY list has an unknown count type: ", filename);
+        }
+      }
+
+      const auto type = parseType(type_name);
+      if (!type) {
+        fail("PLY property has an unknown type: ", filename);
+      }
+      property.type = *type;
+      property.name = nextWord(line);
+      header.elements.back().properties.push_back(property);
+    } else if (keyword == "end_header") {
+      header.size = contents.size() - text.size();
+      break;
+    }
+    // Comments and any other lines are ignored
+  }
+
+  if (!has_format) {
+    fail("PLY header has no format: ", filename);
+  }
+
+  return header;
+}
+
+/** Whether count items of size bytes fit between data and end, checked so it can't overflow. */
+auto fits(const char* data, const char* end, size_t count, size_t size) -> bool {
+  return size == 0 || count <= static_cast<size_t>(end - data) / size;
+}
+
+/**
+ * Reads one item of an element at data, calling fn(property_idx, values, count) with each
+ * property's values, count is 1 unless the property is a list. Returns the end of the item, or
+ * nothing if it runs past end or a list has a negative count.
+ */
+template <typename F>
+auto readItem(const char* data, const char* end, const Element& element, std::endian order,
+              F&& fn) -> const char* {
+  for (size_t idx = 0; idx < element.properties.size(); ++idx) {
+    const auto& property = element.properties[idx];
+
+    int64_t count = 1;
+    if (property.count_type) {
+      const auto count_size = typeSize(*property.count_type);
+      if (static_cast<size_t>(end - data) < count_size) {
+        return nullptr;
+      }
+      count = readAs<int64_t>(data, *property.count_type, order);
+      data += count_size;
+    }
+
+    const auto size = typeSize(property.type);
+    if (count < 0 || !fits(data, end, static_cast<size_t>(count), size)) {
+      return nullptr;
+    }
+    fn(idx, data, static_cast<size_t>(count));
+    data += static_cast<size_t>(count) * size;
+  }
+
+  return data;
+}
+}  // namespace
+
+auto rastrum::ply::isPly(std::string_view contents) -> bool {
+  return contents.starts_with("ply\n") || contents.starts_with("ply\r\n");
+}
+
+auto rastrum::ply::load(const std::string& filename, VertexLayout layout, size_t threads)
+    -> Model {
+  threads = threads == 0 ? parallel::defaultThreads() : threads;
+
+  const MappedFile file(filename);
+  const auto contents = file.data();
+  const auto header = parseHeader(contents, filename);
+  const auto order = header.order;
+
+  const char* data = contents.data() + header.size;
+  const char* const end = contents.data() + contents.size();
+
+  std::vector<Vector3DF> vertices;
+  std::vector<uint32_t> vert_indices;
+  std::vector<Polygon> polygons;
+  std::vector<uint32_t> face;
+  bool has_vertices = false;
+
+  for (const auto& element : header.elements) {
+    const auto stride = element.stride();
+    // Every property takes at least a byte, even an empty list has its count
+    if (!fits(data, end, element.count, stride.value_or(element.properties.size()))) {
+      fail("PLY file is truncated: ", filename);
+    }
+
+    if (element.name == "vertex") {
+      const std::array<std::optional<size_t>, 3> axes{element.find("x"), element.find("y"),
+                                                      element.find("z")};
+      if (!axes[0] || !axes[1] || !axes[2]) {
+        fail("PLY vertices have no x, y and z: ", filename);
+      }
+      if (element.count > std::numeric_limits<uint32_t>::max()) {
+        fail("PLY contains too many vertices: ", filename);
+      }
+      vertices.resize(element.count);
+      has_vertices = true;
+
+      if (stride) {
+        // Every vertex is the same size, so they can be read straight from their offsets
+        std::array<size_t, 3> offsets{};
+        std::array<Type, 3> types{};
+        for (size_t axis = 0; axis < offsets.size(); ++axis) {
+          for (size_t idx = 0; idx < *axes[axis]; ++idx) {
+            offsets[axis] += typeSize(element.properties[idx].type);
+          }
+          types[axis] = element.properties[*axes[axis]].type;
+        }
+
+        parallel::forEach((element.count + kBlockVertices - 1) / kBlockVertices, threads,
+                          [&](size_t block) {
+                            const auto last = std::min(element.count, (block + 1) * kBlockVertices);
+                            for (auto idx = block * kBlockVertices; idx < last; ++idx) {
+                              const char* vert = data + (idx * *stride);
+                              vertices[idx] = Vector3DF{
+                                  {readAs<float>(vert + offsets[0], types[0], order),
+                                   readAs<float>(vert + offsets[1], types[1], order),
+                                   readAs<float>(vert + offsets[2], types[2], order)}};
+                            }
+                          });
+        data += element.count * *stride;
+        continue;
+      }
+
+      for (auto& vert : vertices) {
+        data = readItem(data, end, element, order, [&](size_t idx, const char* values, size_t) {
+          for (size_t axis = 0; axis < axes.size(); ++axis) {
+            if (idx == *axes[axis]) {
+              vert[axis] = readAs<float>(values, element.properties[idx].type, order);
+            }
+          }
+        });
+        if (data == nullptr) {
+          fail("PLY file is truncated: ", filename);
+        }
+      }
+    } else if (element.name == "face") {
+      auto list = element.find("vertex_indices");
+      list = list ? list : element.find("vertex_index");
+      if (!list || !element.properties[*list].count_type) {
+        fail("PLY faces have no vertex_indices list: ", filename);
+      }
+      const auto index_type = element.properties[*list].type;
+      const auto index_size = typeSize(index_type);
+      vert_indices.reserve(element.count * kModelFaceSize);
+
+      for (size_t face_idx = 0; face_idx < element.count; ++face_idx) {
+        face.clear();
+        data = readItem(data, end, element, order,
+                        [&](size_t idx, const char* values, size_t count) {
+                          if (idx != *list) {
+                            return;
+                          }
+                          for (size_t value = 0; value < count; ++value) {
+                            const auto index =
+                                readAs<int64_t>(values + (value * index_size), index_type, order);
+                            if (index < 0 || index > std::numeric_limits<uint32_t>::max()) {
+                              fail("PLY face has a bad index: ", filename);
+                            }
+                            face.push_back(static_cast<uint32_t>(index));
+                          }
+                        });
+        if (data == nullptr) {
+          fail("PLY file is truncated: ", filename);
+        }
+        if (face.size() < kModelFaceSize) {
+          fail("PLY face has fewer than 3 vertices: ", filename);
+        }
+
+        // Write polygons as a fan for now, they are triangulated once every vertex is known
+        if (face.size() > kModelFaceSize) {
+          polygons.push_back({vert_indices.size(), face.size()});
+        }
+        for (size_t idx = 1; idx + 1 < face.size(); ++idx) {
+          vert_indices.insert(vert_indices.end(), {face[0], face[idx], face[idx + 1]});
+        }
+      }
+    } else if (stride) {
+      data += element.count * *stride;
+    } else {
+      for (size_t idx = 0; idx < element.count && data != nullptr; ++idx) {
+        data = readItem(data, end, element, order, [](size_t, const char*, size_t) {});
+      }
+      if (data == nullptr) {
+        fail("PLY file is truncated: ", filename);
+      }
+    }
+  }
+
+  if (!has_vertices) {
+    fail("PLY file has no vertex element: ", filename);
+  }
+
+  for (const auto index : vert_indices) {
+    if (index >= vertices.size()) {
+      fail("PLY contains indices to verts that don't exist: ", filename);
+    }
+  }
+
+  for (const auto& polygon : polygons) {
+    mesh::triangulate(vert_indices.data() + polygon.first_index, polygon.sides, vertices.data());
+  }
+
+  mesh::weld(vertices, vert_indices, threads);
+
+  const auto unique_count = vertices.size();
+  return {std::move(vertices), IndexBuffer(std::move(vert_indices), unique_count), layout};
+}
@@ -0,0 +1,307 @@
+#include "rastrum/Renderer.h"
+
+#include <algorithm>
+#include <array>
+
+#include "parallel.h"
+
+static_assert(rastrum::Renderer::kTileSize % rastrum::FrameBuffer::kTileAlignment == 0,
+              "Renderer tiles must not share depth tiles between workers");
+
+namespace {
+/** The number of a compressed model's vertices converted to floats at once. */
+constexpr size_t kDecodeBatch = 1024;
+
+/** Transforms a vertex into homogeneous coordinates, without dividing by w. */
+auto toHomogeneous(const rastrum::Matrix4F& transform, const rastrum::Vector3DF& vert)
+    -> rastrum::Vector4DF {
+  return transform * rastrum::Vector4DF{{vert.x(), vert.y(), vert.z(), 1}};
+}
+}  // namespace
+
+template <typename Format>
+rastrum::BasicRenderer<Format>::BasicRenderer(BasicFrameBuffer<Format>& buffer, size_t threads)
+    : _buffer(buffer),
+      _pool(std::make_unique<parallel::Pool>(threads == 0 ? parallel::defaultThreads() : threads)),
+      _geometry(buffer.width(), buffer.height()),
+      _tiles_x(static_cast<int>((buffer.width() + kTileSize - 1) / kTileSize)),
+      _tiles_y(static_cast<int>((buffer.height() + kTileSize - 1) / kTileSize)),
+      _bins(static_cast<size_t>(_tiles_x) * _tiles_y) {
+}
+
+template <typename Format>
+rastrum::BasicRenderer<Format>::~BasicRenderer() = default;
+
+template <typename Format>
+void rastrum::BasicRenderer<Format>::fillTriangle(Vector3DF a, Vector3DF b, Vector3DF c,
+                                                  RGBA value) {
+  _geometry.process(a, b, c, [&](Vector3DF clip_a, Vector3DF clip_b, Vector3DF clip_c) {
+    bin(clip_a, clip_b, clip_c, value);
+  });
+}
+
+template <typename Format>
+void rastrum::BasicRenderer<Format>::drawModel(const Model& model, const VertexTransform& transform,
+                                               const FaceShader& shader) {
+  const auto& vertices = model.vertices();
+  _transformed.resize(vertices.size());
+  std::transform(vertices.begin(), vertices.end(), _transformed.begin(), transform);
+  drawTransformed(model, nullptr, shader);
+}
+
+template <typename Format>
+void rastrum::BasicRenderer<Format>::drawModel(const Model& model, const Matrix4F& transform,
+                                               const FaceShader& shader) {
+  const auto& vertices = model.vertices();
+  _transformed.resize(vertices.size());
+
+  if (model.layout() == VertexLayout::kSoA) {
+    const auto& arrays = model.vertex_arrays();
+    transformPoints(transform, arrays.x.data(), arrays.y.data(), arrays.z.data(),
+                    _transformed.data(), vertices.size());
+  } else {
+    transformPoints(transform, vertices.data(), _transformed.data(), vertices.size());
+  }
+
+  drawTransformed(model, &transform, shader);
+}
+
+template <typename Format>
+void rastrum::BasicRenderer<Format>::drawModel(const Model& model, const Bvh& bvh,
+                                               const Matrix4F& transform,
+                                               const FaceShader& shader) {
+  const Frustum frustum(transform, _geometry.viewport());
+  _visible_faces.clear();
+  bvh.cull(frustum, [this](std::span<const uint32_t> faces) {
+    _visible_faces.insert(_visible_faces.end(), faces.begin(), faces.end());
+  });
+
+  if (_visible_faces.size() == model.face_count()) {
+    drawModel(model, transform, shader);
+    return;
+  }
+
+  // Gather the vertices the visible faces use so they can still be transformed in batches
+  const auto vertices = model.vertices();
+  _transformed.resize(vertices.size());
+  _vertex_visible.assign(vertices.size(), false);
+  _visible_vertices.clear();
+  _gathered.clear();
+
+  model.vert_indices().visit([&](auto indices) {
+    for (const auto face_idx : _visible_faces) {
+      for (size_t corner = 0; corner < kModelFaceSize; ++corner) {
+        const auto vert_idx = indices[(face_idx * kModelFaceSize) + corner];
+        if (!_vertex_visible[vert_idx]) {
+          _vertex_visible[vert_idx] = true;
+          _visible_vertices.push_back(static_cast<uint32_t>(vert_idx));
+          _gathered.push_back(vertices[vert_idx]);
+        }
+      }
+    }
+  });
+
+  transformPoints(transform, _gathered.data(), _gathered.data(), _gathered.size());
+  for (size_t idx = 0; idx < _visible_vertices.size(); ++idx) {
+    _transformed[_visible_vertices[idx]] = _gathered[idx];
+  }
+
+  drawTransformed(model, _visible_faces, &transform, shader);
+}
+
+template <typename Format>
+void rastrum::BasicRenderer<Format>::drawModel(const Model& model, const Meshlets& meshlets,
+                                               const Matrix4F& transform,
+                                               const FaceShader& shader) {
+  const Frustum frustum(transform, _geometry.viewport());
+  const auto vertices = model.vertices();
+  std::array<Vector3DF, Meshlets::kMaxVertices> transformed;
+
+  for (const auto& meshlet : meshlets.meshlets()) {
+    if (_geometry.cullCluster(frustum, meshlet.center, meshlet.radius, meshlet.cone,
+                              meshlet.face_count) != Cull::kNone) {
+      continue;
+    }
+
+    const auto cluster_vertices =
+        meshlets.vertices().subspan(meshlet.vertex_offset, meshlet.vertex_count);
+    for (size_t idx = 0; idx < cluster_vertices.size(); ++idx) {
+      transformed[idx] = vertices[cluster_vertices[idx]];
+    }
+    transformPoints(transform, transformed.data(), transformed.data(), cluster_vertices.size());
+
+    const auto indices = meshlets.indices().subspan(meshlet.face_offset * kModelFaceSize,
+                                                    meshlet.face_count * kModelFaceSize);
+    for (size_t face = 0; face < meshlet.face_count; ++face) {
+      const auto base = face * kModelFaceSize;
+      const auto homogeneous = [&](size_t corner) {
+        return toHomogeneous(transform, vertices[cluster_vertices[indices[base + corner]]]);
+      };
+      drawFace(transformed[indices[base]], transformed[indices[base + 1]],
+               transformed[indices[base + 2]], meshlets.faces()[meshlet.face_offset + face],
+               shader,
+               [&]() { return std::array{homogeneous(0), homogeneous(1), homogeneous(2)}; });
+    }
+  }
+}
+
+template <typename Format>
+void rastrum::BasicRenderer<Format>::drawModel(const CompressedModel& model,
+                                               const Matrix4F& transform,
+                                               const FaceShader& shader) {
+  const auto vertex_count = model.vertex_count();
+  _transformed.resize(vertex_count);
+  _decoded.resize(kDecodeBatch * 3);
+  float* const xs = _decoded.data();
+  float* const ys = xs + kDecodeBatch;
+  float* const zs = ys + kDecodeBatch;
+
+  // Transforming the quantized coordinates by the dequantization saves a multiply and add each
+  const auto full = transform * model.dequantization();
+  for (size_t first = 0; first < vertex_count; first += kDecodeBatch) {
+    const auto count = std::min(kDecodeBatch, vertex_count - first);
+    model.decodeVertices(first, count, xs, ys, zs);
+    transformPoints(full, xs, ys, zs, &_transformed[first], count);
+  }
+
+  std::array<uint32_t, CompressedModel::kBlockFaces * kModelFaceSize> indices{};
+  for (size_t block = 0; block < model.block_count(); ++block) {
+    const auto count = model.decodeIndices(block, indices.data());
+    const auto first_face = block * CompressedModel::kBlockFaces;
+    for (size_t base = 0; base < count; base += kModelFaceSize) {
+      const auto homogeneous = [&](size_t corner) {
+        Vector3DF vert;
+        model.decodeVertices(indices[base + corner], 1, &vert[0], &vert[1], &vert[2]);
+        return toHomogeneous(full, vert);
+      };
+      drawFace(_transformed[indices[base]], _transformed[indices[base + 1]],
+               _transformed[indices[base + 2]], first_face + (base / kModelFaceSize), shader,
+               [&]() { return std::array{homogeneous(0), homogeneous(1), homogeneous(2)}; });
+    }
+  }
+}
+
+template <typename Format>
+void rastrum::BasicRenderer<Format>::drawTransformed(const Model& model, const Matrix4F* transform,
+                                                     const FaceShader& shader) {
+  model.vert_indices().visit([&](auto indices) {
+    for (size_t face_idx = 0; face_idx < model.face_count(); ++face_idx) {
+      const auto base = face_idx * kModelFaceSize;
+      const auto homogeneous = [&](size_t corner) {
+        const auto vert_idx = indices[base + corner];
+        return transform != nullptr ? toHomogeneous(*transform, model.vertices()[vert_idx])
+                                    : toHomogeneous(Matrix4F::identity(), _transformed[vert_idx]);
+      };
+      drawFace(_transformed[indices[base]], _transformed[indices[base + 1]],
+               _transformed[indices[base + 2]], face_idx, shader,
+               [&]() { return std::array{homogeneous(0), homogeneous(1), homogeneous(2)}; });
+    }
+  });
+}
+
+template <typename Format>
+void rastrum::BasicRenderer<Format>::drawTransformed(const Model& model,
+                                                     std::span<const uint32_t> faces,
+                                                     const Matrix4F* transform,
+                                                     const FaceShader& shader) {
+  model.vert_indices().visit([&](auto indices) {
+    for (const auto face_idx : faces) {
+      const auto base = face_idx * kModelFaceSize;
+      const auto homogeneous = [&](size_t corner) {
+        const auto vert_idx = indices[base + corner];
+        return transform != nullptr ? toHomogeneous(*transform, model.vertices()[vert_idx])
+                                    : toHomogeneous(Matrix4F::identity(), _transformed[vert_idx]);
+      };
+      drawFace(_transformed[indices[base]], _transformed[indices[base + 1]],
+               _transformed[indices[base + 2]], face_idx, shader,
+               [&]() { return std::array{homogeneous(0), homogeneous(1), homogeneous(2)}; });
+    }
+  });
+}
+
+template <typename Format>
+template <typename H>
+void rastrum::BasicRenderer<Format>::drawFace(Vector3DF a, Vector3DF b, Vector3DF c,
+                                              size_t face_idx, const FaceShader& shader,
+                                              H&& homogeneous) {
+  std::optional<RGBA> value;
+  bool shaded = false;
+
+  _geometry.process(a, b, c, homogeneous,
+                    [&](Vector3DF clip_a, Vector3DF clip_b, Vector3DF clip_c) {
+                      // Clipped faces can emit several triangles, only shade them once
+                      if (!shaded) {
+                        value = shader(face_idx);
+                        shaded = true;
+                      }
+
+                      if (value) {
+                        bin(clip_a, clip_b, clip_c, *value);
+                      }
+                    });
+}
+
+template <typename Format>
+void rastrum::BasicRenderer<Format>::setDepthRange(float min_z, float max_z) {
+  _geometry.setDepthRange(min_z, max_z);
+}
+
+template <typename Format>
+void rastrum::BasicRenderer<Format>::bin(Vector3DF a, Vector3DF b, Vector3DF c, RGBA value) {
+  // Bin by bounding box, padded so vertices snapping to the sub-pixel grid can't move a
+  // covered pixel into a tile the triangle wasn't binned in
+  const Pixel min = rastrum::min(rastrum::min(a, b), c).floor().as<int>().resize<2>();
+  const auto ceil_max = rastrum::max(rastrum::max(a, b), c).ceil().as<int>();
+  const Pixel max{{ceil_max.x() + 1, ceil_max.y() + 1}};
+
+  const int tile_min_x = std::max(min.x(), 0) / kTileSize;
+  const int tile_min_y = std::max(min.y(), 0) / kTileSize;
+  const int tile_max_x = std::min((max.x() - 1) / kTileSize, _tiles_x - 1);
+  const int tile_max_y = std::min((max.y() - 1) / kTileSize, _tiles_y - 1);
+
+  const auto tri_idx = static_cast<uint32_t>(_triangles.size());
+  _triangles.push_back({a, b, c, value});
+
+  for (int tile_y = tile_min_y; tile_y <= tile_max_y; ++tile_y) {
+    for (int tile_x = tile_min_x; tile_x <= tile_max_x; ++tile_x) {
+      _bins[(static_cast<size_t>(tile_y) * _tiles_x) + tile_x].push_back(tri_idx);
+    }
+  }
+}
+
+template <typename Format>
+void rastrum::BasicRenderer<Format>::flush() {
+  _pool->forEach(_bins.size(), [this](size_t tile_idx) {
+    const auto tile_x = static_cast<int>(tile_idx % _tiles_x);
+    const auto tile_y = static_cast<int>(tile_idx / _tiles_x);
+    const Pixel clip_min{{tile_x * kTileSize, tile_y * kTileSize}};
+    const Pixel clip_max{
+        {std::min(clip_min.x() + kTileSize, static_cast<int>(_buffer.width())),
+         std::min(clip_min.y() + kTileSize, static_cast<int>(_buffer.height()))}};
+
+    for (const auto tri_idx : _bins[tile_idx]) {
+      const auto& tri = _triangles[tri_idx];
+      _buffer.fillTriangle(tri.a, tri.b, tri.c, tri.value, clip_min, clip_max);
+    }
+  });
+
+  _triangles.clear();
+  for (auto& bin : _bins) {
+    bin.clear();
+  }
+}
+
+template <typename Format>
+auto rastrum::BasicRenderer<Format>::threads() const -> size_t {
+  return _pool->threads();
+}
+
+template <typename Format>
+auto rastrum::BasicRenderer<Format>::stats() const -> const CullStats& {
+  return _geometry.stats();
+}
+
+template class rastrum::BasicRenderer<rastrum::RGBA8>;
+template class rastrum::BasicRenderer<rastrum::BGRA8>;
+template class rastrum::BasicRenderer<rastrum::RGB565>;
+template class rastrum::BasicRenderer<rastrum::RGBA32F>;
@@ -0,0 +1,76 @@
+#include "rastrum/Stl.h"
+
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include <vector>
+
+#include "MappedFile.h"
+#include "binary.h"
+#include "mesh.h"
+#include "parallel.h"
+
+namespace {
+constexpr size_t kHeaderSize = 80;
+/** The size of the header plus the triangle count. */
+constexpr size_t kPreambleSize = kHeaderSize + sizeof(uint32_t);
+/** A normal, three vertices and two attribute bytes. */
+constexpr size_t kTriangleSize = 50;
+constexpr size_t kNormalSize = 3 * sizeof(float);
+
+/** The number of triangles each worker reads at a time. */
+constexpr size_t kBlockTriangles = size_t{1} << 16;
+}  // namespace
+
+auto rastrum::stl::isBinary(std::string_view contents) -> bool {
+  if (contents.size() < kPreambleSize) {
+    return false;
+  }
+
+  const auto count = binary::read<uint32_t>(contents.data() + kHeaderSize);
+  return contents.size() == kPreambleSize + (size_t{count} * kTriangleSize);
+}
+
+auto rastrum::stl::load(const std::string& filename, VertexLayout layout, size_t threads)
+    -> Model {
+  threads = threads == 0 ? parallel::defaultThreads() : threads;
+
+  const MappedFile file(filename);
+  const auto contents = file.data();
+  if (!isBinary(contents)) {
+    std::cerr << "Not a binary STL file: " << filename << "\n";
+    exit(1);
+  }
+
+  const size_t triangle_count = binary::read<uint32_t>(contents.data() + kHeaderSize);
+  const auto vertex_count = triangle_count * kModelFaceSize;
+  if (vertex_count > std::numeric_limits<uint32_t>::max()) {
+    std::cerr << "STL contains too many triangles: " << triangle_count << "\n";
+    exit(1);
+  }
+
+  std::vector<Vector3DF> vertices(vertex_count);
+  const char* const triangles = contents.data() + kPreambleSize;
+  parallel::forEach((triangle_count + kBlockTriangles - 1) / kBlockTriangles, threads,
+                    [&](size_t block) {
+                      const auto end = std::min(triangle_count, (block + 1) * kBlockTriangles);
+                      for (auto tri = block * kBlockTriangles; tri < end; ++tri) {
+                        const char* corner = triangles + (tri * kTriangleSize) + kNormalSize;
+                        for (size_t idx = 0; idx < kModelFaceSize; ++idx) {
+                          vertices[(tri * kModelFaceSize) + idx] = Vector3DF{
+                              {binary::read<float>(corner), binary::read<float>(corner + 4),
+                               binary::read<float>(corner + 8)}};
+                          corner += 3 * sizeof(float);
+                        }
+                      }
+                    });
+
+  // Every corner starts as its own vertex, welding shares them between triangles
+  std::vector<uint32_t> vert_indices(vertex_count);
+  std::iota(vert_indices.begin(), vert_indices.end(), 0);
+  mesh::weld(vertices, vert_indices, threads);
+
+  const auto unique_count = vertices.size();
+  return {std::move(vertices), IndexBuffer(std::move(vert_indices), unique_count), layout};
+}
@@ -0,0 +1,114 @@
+#include "rastrum/Vector.h"
+
+#include <limits>
+
+#include "simd.h"
+
+namespace {
+/** Transforms a single point, see rastrum::transformPoints. */
+auto transformPoint(const rastrum::Matrix4F& matrix, const rastrum::Vector3DF& point)
+    -> rastrum::Vector3DF {
+  std::array<float, 4> res{};
+  for (size_t row = 0; row < res.size(); ++row) {
+    res[row] = (matrix(row, 0) * point.x()) + (matrix(row, 1) * point.y()) +
+               (matrix(row, 2) * point.z()) + matrix(row, 3);
+  }
+
+  if (!(res[3] > 0)) {
+    constexpr auto kNaN = std::numeric_limits<float>::quiet_NaN();
+    return rastrum::Vector3DF{{kNaN, kNaN, kNaN}};
+  }
+
+  return rastrum::Vector3DF{{res[0] / res[3], res[1] / res[3], res[2] / res[3]}};
+}
+
+#if defined(__SSE2__)
+using rastrum::simd::kWidth;
+
+/** A matrix with every element broadcast to each lane. */
+class BroadcastMatrix {
+ public:
+  explicit BroadcastMatrix(const rastrum::Matrix4F& matrix) {
+    for (size_t row = 0; row < _rows.size(); ++row) {
+      _rows[row] = {_mm_set1_ps(matrix(row, 0)), _mm_set1_ps(matrix(row, 1)),
+                    _mm_set1_ps(matrix(row, 2)), _mm_set1_ps(matrix(row, 3))};
+    }
+  }
+
+  /**
+   * Transforms kWidth points given as a register of each coordinate and writes them to out as
+   * Vector3DFs.
+   */
+  void transform(__m128 x, __m128 y, __m128 z, rastrum::Vector3DF* out) const {
+    const auto dot = [&](const Row& row) {
+      return _mm_add_ps(
+          _mm_add_ps(_mm_add_ps(_mm_mul_ps(row.x, x), _mm_mul_ps(row.y, y)), _mm_mul_ps(row.z, z)),
+          row.w);
+    };
+    const __m128 res_w = dot(_rows[3]);
+
+    // Divide by w, points behind the viewer become NaN
+    const __m128 in_front = _mm_cmpgt_ps(res_w, _mm_setzero_ps());
+    const __m128 nan = _mm_set1_ps(std::numeric_limits<float>::quiet_NaN());
+    const auto project = [&](const Row& row) {
+      const __m128 projected = _mm_div_ps(dot(row), res_w);
+      return _mm_or_ps(_mm_and_ps(in_front, projected), _mm_andnot_ps(in_front, nan));
+    };
+    const __m128 out_x = project(_rows[0]);
+    const __m128 out_y = project(_rows[1]);
+    const __m128 out_z = project(_rows[2]);
+
+    rastrum::simd::store3(out, out_x, out_y, out_z);
+  }
+
+ private:
+  struct Row {
+    __m128 x;
+    __m128 y;
+    __m128 z;
+    __m128 w;
+  };
+
+  std::array<Row, 4> _rows{};
+};
+#endif
+}  // namespace
+
+void rastrum::transformPoints(const Matrix4F& matrix, const Vector3DF* points, Vector3DF* out,
+                              size_t count) {
+  size_t idx = 0;
+
+#if defined(__SSE2__)
+  const BroadcastMatrix broadcast(matrix);
+
+  for (; idx + kWidth <= count; idx += kWidth) {
+    __m128 x;
+    __m128 y;
+    __m128 z;
+    rastrum::simd::load3(points + idx, x, y, z);
+    broadcast.transform(x, y, z, out + idx);
+  }
+#endif
+
+  for (; idx < count; ++idx) {
+    out[idx] = transformPoint(matrix, points[idx]);
+  }
+}
+
+void rastrum::transformPoints(const Matrix4F& matrix, const float* xs, const float* ys,
+                              const float* zs, Vector3DF* out, size_t count) {
+  size_t idx = 0;
+
+#if defined(__SSE2__)
+  const BroadcastMatrix broadcast(matrix);
+
+  for (; idx + kWidth <= count; idx += kWidth) {
+    broadcast.transform(_mm_load_ps(xs + idx), _mm_load_ps(ys + idx), _mm_load_ps(zs + idx),
+                        out + idx);
+  }
+#endif
+
+  for (; idx < count; ++idx) {
+    out[idx] = transformPoint(matrix, Vector3DF{{xs[idx], ys[idx], zs[idx]}});
+  }
+}
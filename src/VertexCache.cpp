@@ -0,0 +1,231 @@
+#include "rastrum/VertexCache.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+namespace {
+// Weights from Forsyth's "Linear-Speed Vertex Cache Optimisation"
+constexpr float kCacheDecayPower = 1.5F;
+constexpr float kLastFaceScore = 0.75F;
+constexpr float kValenceBoostScale = 2.0F;
+constexpr float kValenceBoostPower = 0.5F;
+
+/** Marks a vertex that hasn't been given a new index yet. */
+constexpr auto kUnmapped = std::numeric_limits<uint32_t>::max();
+
+/** Vertices with more faces than this left score the same as ones with exactly this many. */
+constexpr uint32_t kMaxValence = 32;
+
+/**
+ * Forsyth's vertex scores, looked up by a vertex's position in the cache and the number of faces
+ * still to be emitted that use it. Vertices that were just used and ones with few faces left
+ * score highest.
+ */
+class VertexScores {
+ public:
+  explicit VertexScores(size_t cache_size) : _cache(cache_size + 1, 0) {
+    // The vertices of the last face get a fixed score so faces sharing an edge with it aren't
+    // favoured over ones that reuse a vertex
+    const auto scale = 1.0F / static_cast<float>(cache_size - rastrum::kModelFaceSize);
+    for (size_t pos = 0; pos < cache_size; ++pos) {
+      _cache[pos] = pos < rastrum::kModelFaceSize
+                        ? kLastFaceScore
+                        : std::pow(1.0F - (static_cast<float>(pos - rastrum::kModelFaceSize) *
+                                           scale),
+                                   kCacheDecayPower);
+    }
+
+    _valence[0] = -1;
+    for (uint32_t remaining = 1; remaining <= kMaxValence; ++remaining) {
+      _valence[remaining] =
+          kValenceBoostScale * std::pow(static_cast<float>(remaining), -kValenceBoostPower);
+    }
+  }
+
+  /** The score of a vertex at cache_pos, or cache_size if it isn't cached. */
+  auto operator()(size_t cache_pos, uint32_t remaining) const -> float {
+    if (remaining == 0) {
+      return -1;
+    }
+    return _cache[cache_pos] + _valence[std::min(remaining, kMaxValence)];
+  }
+
+ private:
+  std::vector<float> _cache;
+  std::array<float, kMaxValence + 1> _valence{};
+};
+
+/** Orders the faces of indices greedily, always emitting the face whose vertices score highest. */
+template <typename T>
+auto orderFaces(std::span<const T> indices, size_t vertex_count, size_t cache_size)
+    -> std::vector<uint32_t> {
+  const auto face_count = indices.size() / rastrum::kModelFaceSize;
+
+  // The faces using each vertex that are still to be emitted are kept at the start of its range
+  std::vector<uint32_t> remaining(vertex_count, 0);
+  for (const auto index : indices) {
+    ++remaining[index];
+  }
+
+  std::vector<uint32_t> first_face(vertex_count + 1, 0);
+  for (size_t vert = 0; vert < vertex_count; ++vert) {
+    first_face[vert + 1] = first_face[vert] + remaining[vert];
+  }
+
+  std::vector<uint32_t> vertex_faces(indices.size());
+  std::vector<uint32_t> filled(first_face.begin(), first_face.end() - 1);
+  for (size_t idx = 0; idx < indices.size(); ++idx) {
+    vertex_faces[filled[indices[idx]]++] = static_cast<uint32_t>(idx / rastrum::kModelFaceSize);
+  }
+
+  const VertexScores score(cache_size);
+  std::vector<float> vertex_scores(vertex_count);
+  for (size_t vert = 0; vert < vertex_count; ++vert) {
+    vertex_scores[vert] = score(cache_size, remaining[vert]);
+  }
+
+  std::vector<float> face_scores(face_count, 0);
+  for (size_t idx = 0; idx < indices.size(); ++idx) {
+    face_scores[idx / rastrum::kModelFaceSize] += vertex_scores[indices[idx]];
+  }
+
+  std::vector<bool> emitted(face_count, false);
+  std::vector<uint32_t> order;
+  order.reserve(face_count);
+
+  // Holds cache_size vertices, plus room for a new face's before the oldest are dropped
+  std::vector<uint32_t> cache;
+  std::vector<uint32_t> next_cache;
+  cache.reserve(cache_size + rastrum::kModelFaceSize);
+  next_cache.reserve(cache_size + rastrum::kModelFaceSize);
+
+  size_t next_unemitted = 0;
+  auto best_face = face_count;
+
+  while (order.size() < face_count) {
+    // Nothing in the cache has faces left, start again from the next face in the original order
+    if (best_face == face_count) {
+      while (emitted[next_unemitted]) {
+        ++next_unemitted;
+      }
+      best_face = next_unemitted;
+    }
+
+    order.push_back(static_cast<uint32_t>(best_face));
+    emitted[best_face] = true;
+
+    // Remove the face from its vertices and move them to the front of the cache
+    next_cache.clear();
+    for (size_t corner = 0; corner < rastrum::kModelFaceSize; ++corner) {
+      const auto vert = indices[(best_face * rastrum::kModelFaceSize) + corner];
+      const auto begin = vertex_faces.begin() + first_face[vert];
+      const auto end = begin + remaining[vert];
+      std::iter_swap(std::find(begin, end, best_face), end - 1);
+      --remaining[vert];
+
+      next_cache.push_back(vert);
+    }
+
+    for (const auto vert : cache) {
+      if (std::find(next_cache.begin(), next_cache.begin() + rastrum::kModelFaceSize, vert) ==
+          next_cache.begin() + rastrum::kModelFaceSize) {
+        next_cache.push_back(vert);
+      }
+    }
+
+    // Rescore every vertex that moved in or out of the cache, and their faces
+    for (size_t pos = 0; pos < next_cache.size(); ++pos) {
+      const auto vert = next_cache[pos];
+      const auto vertex_score = score(std::min(pos, cache_size), remaining[vert]);
+      const auto delta = vertex_score - vertex_scores[vert];
+      vertex_scores[vert] = vertex_score;
+
+      for (auto face = first_face[vert]; face < first_face[vert] + remaining[vert]; ++face) {
+        face_scores[vertex_faces[face]] += delta;
+      }
+    }
+
+    next_cache.resize(std::min(next_cache.size(), cache_size));
+    std::swap(cache, next_cache);
+
+    // The best face to emit next is almost always one using a vertex in the cache
+    best_face = face_count;
+    float best_score = -1;
+    for (const auto vert : cache) {
+      for (auto face = first_face[vert]; face < first_face[vert] + remaining[vert]; ++face) {
+        if (face_scores[vertex_faces[face]] > best_score) {
+          best_face = vertex_faces[face];
+          best_score = face_scores[best_face];
+        }
+      }
+    }
+  }
+
+  return order;
+}
+}  // namespace
+
+auto rastrum::acmr(const Model& model, size_t cache_size) -> float {
+  if (model.face_count() == 0) {
+    return 0;
+  }
+
+  // A vertex is in the FIFO cache if fewer than cache_size vertices were added after it
+  constexpr auto kNever = std::numeric_limits<size_t>::max();
+  std::vector<size_t> added(model.vertices().size(), kNever);
+  size_t misses = 0;
+
+  model.vert_indices().visit([&](auto indices) {
+    for (const auto index : indices) {
+      if (added[index] == kNever || misses - added[index] >= cache_size) {
+        added[index] = misses;
+        ++misses;
+      }
+    }
+  });
+
+  return static_cast<float>(misses) / static_cast<float>(model.face_count());
+}
+
+auto rastrum::optimizeVertexCache(const Model& model, size_t cache_size) -> Model {
+  const auto vertices = model.vertices();
+  cache_size = std::max<size_t>(cache_size, kModelFaceSize + 1);
+
+  std::vector<uint32_t> vert_indices;
+  vert_indices.reserve(model.vert_indices().size());
+  std::vector<uint32_t> remap(vertices.size(), kUnmapped);
+  std::vector<Vector3DF> reordered;
+  reordered.reserve(vertices.size());
+
+  // Emit the faces in their new order, numbering vertices as they are first used
+  model.vert_indices().visit([&](auto indices) {
+    for (const auto face : orderFaces(indices, vertices.size(), cache_size)) {
+      for (size_t corner = 0; corner < kModelFaceSize; ++corner) {
+        const auto index = indices[(face * kModelFaceSize) + corner];
+        if (remap[index] == kUnmapped) {
+          remap[index] = static_cast<uint32_t>(reordered.size());
+          reordered.push_back(vertices[index]);
+        }
+        vert_indices.push_back(remap[index]);
+      }
+    }
+  });
+
+  // Keep any vertices no face uses at the end
+  for (size_t idx = 0; idx < vertices.size(); ++idx) {
+    if (remap[idx] == kUnmapped) {
+      reordered.push_back(vertices[idx]);
+    }
+  }
+
+  Model optimized(std::move(reordered), IndexBuffer(std::move(vert_indices), vertices.size()),
+                  model.layout());
+  if (model.precomputed()) {
+    optimized.precompute();
+  }
+
+  return optimized;
+}
@@ -0,0 +1,34 @@
+#ifndef RASTRUM_BINARY_H
+#define RASTRUM_BINARY_H
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstring>
+
+namespace rastrum::binary {
+
+/** Reads a T stored at data with the given byte order, data needn't be aligned. */
+template <typename T>
+auto read(const char* data, std::endian order = std::endian::little) -> T {
+  std::array<char, sizeof(T)> bytes{};
+  std::memcpy(bytes.data(), data, sizeof(T));
+  if (order != std::endian::native) {
+    std::reverse(bytes.begin(), bytes.end());
+  }
+  return std::bit_cast<T>(bytes);
+}
+
+/** Writes a T to data with the given byte order, data needn't be aligned. */
+template <typename T>
+void write(char* data, T value, std::endian order = std::endian::little) {
+  auto bytes = std::bit_cast<std::array<char, sizeof(T)>>(value);
+  if (order != std::endian::native) {
+    std::reverse(bytes.begin(), bytes.end());
+  }
+  std::memcpy(data, bytes.data(), sizeof(T));
+}
+
+}  // namespace rastrum::binary
+
+#endif
@@ -0,0 +1,158 @@
+#include "mesh.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <limits>
+
+#include "parallel.h"
+#include "rastrum/Model.h"
+
+namespace {
+/** Hashes the bits of a vertex. */
+auto hashVertex(const std::array<uint32_t, 3>& bits) -> uint64_t {
+  constexpr uint64_t kMul = 0x9E3779B97F4A7C15;
+  uint64_t hash = 0;
+  for (const auto word : bits) {
+    hash = (hash ^ word) * kMul;
+  }
+  return hash ^ (hash >> 32);
+}
+}  // namespace
+
+void rastrum::mesh::triangulate(uint32_t* indices, size_t sides, const Vector3DF* vertices) {
+  // Recover the polygon from the fan
+  std::vector<uint32_t> polygon{indices[0], indices[1]};
+  for (size_t tri = 0; tri < sides - 2; ++tri) {
+    polygon.push_back(indices[(tri * rastrum::kModelFaceSize) + 2]);
+  }
+
+  // Newell's method gives the normal of a possibly concave polygon
+  rastrum::Vector3DF normal{{0, 0, 0}};
+  for (size_t idx = 0; idx < sides; ++idx) {
+    const auto& cur = vertices[polygon[idx]];
+    const auto& next = vertices[polygon[(idx + 1) % sides]];
+    normal.x(normal.x() + ((cur.y() - next.y()) * (cur.z() + next.z())));
+    normal.y(normal.y() + ((cur.z() - next.z()) * (cur.x() + next.x())));
+    normal.z(normal.z() + ((cur.x() - next.x()) * (cur.y() + next.y())));
+  }
+
+  // Drop the axis the normal is strongest along, swapping the others if needed so the polygon
+  // winds anti-clockwise in 2D
+  const std::array<float, 3> abs_normal{std::abs(normal.x()), std::abs(normal.y()),
+                                        std::abs(normal.z())};
+  const auto drop = static_cast<size_t>(
+      std::max_element(abs_normal.begin(), abs_normal.end()) - abs_normal.begin());
+  auto axis_u = (drop + 1) % 3;
+  auto axis_v = (drop + 2) % 3;
+  if (normal[drop] < 0) {
+    std::swap(axis_u, axis_v);
+  }
+
+  const auto point = [&](uint32_t vert) {
+    return std::array<float, 2>{vertices[vert][axis_u], vertices[vert][axis_v]};
+  };
+  const auto cross = [](std::array<float, 2> a, std::array<float, 2> b, std::array<float, 2> c) {
+    return ((b[0] - a[0]) * (c[1] - a[1])) - ((b[1] - a[1]) * (c[0] - a[0]));
+  };
+
+  size_t out = 0;
+  const auto emit = [&](uint32_t a, uint32_t b, uint32_t c) {
+    indices[out++] = a;
+    indices[out++] = b;
+    indices[out++] = c;
+  };
+
+  while (polygon.size() > 3) {
+    bool clipped = false;
+
+    for (size_t idx = 0; idx < polygon.size() && !clipped; ++idx) {
+      const auto prev = polygon[(idx + polygon.size() - 1) % polygon.size()];
+      const auto cur = polygon[idx];
+      const auto next = polygon[(idx + 1) % polygon.size()];
+      const auto a = point(prev);
+      const auto b = point(cur);
+      const auto c = point(next);
+
+      // An ear is convex and has no other vertex inside it
+      if (cross(a, b, c) <= 0) {
+        continue;
+      }
+
+      const bool ear = std::none_of(polygon.begin(), polygon.end(), [&](uint32_t other) {
+        const auto p = point(other);
+        return other != prev && other != cur && other != next && cross(a, b, p) >= 0 &&
+               cross(b, c, p) >= 0 && cross(c, a, p) >= 0;
+      });
+
+      if (ear) {
+        emit(prev, cur, next);
+        polygon.erase(polygon.begin() + static_cast<std::ptrdiff_t>(idx));
+        clipped = true;
+      }
+    }
+
+    if (!clipped) {
+      break;
+    }
+  }
+
+  for (size_t idx = 1; idx + 1 < polygon.size(); ++idx) {
+    emit(polygon[0], polygon[idx], polygon[idx + 1]);
+  }
+}
+
+void rastrum::mesh::weld(std::vector<Vector3DF>& vertices, std::vector<uint32_t>& vert_indices,
+                         size_t threads) {
+  constexpr auto kEmpty = std::numeric_limits<uint32_t>::max();
+  const auto capacity = std::bit_ceil(std::max<size_t>(vertices.size() * 2, 16));
+  std::vector<uint32_t> slots(capacity, kEmpty);
+  std::vector<uint32_t> remap(vertices.size());
+  uint32_t unique = 0;
+
+  for (size_t idx = 0; idx < vertices.size(); ++idx) {
+    // Adding zero turns -0 into 0 so they weld together
+    const auto& vert = vertices[idx];
+    const std::array<uint32_t, 3> bits{std::bit_cast<uint32_t>(vert.x() + 0.0F),
+                                       std::bit_cast<uint32_t>(vert.y() + 0.0F),
+                                       std::bit_cast<uint32_t>(vert.z() + 0.0F)};
+
+    auto slot = hashVertex(bits) & (capacity - 1);
+    while (slots[slot] != kEmpty) {
+      const auto& other = vertices[slots[slot]];
+      if (std::bit_cast<uint32_t>(other.x() + 0.0F) == bits[0] &&
+          std::bit_cast<uint32_t>(other.y() + 0.0F) == bits[1] &&
+          std::bit_cast<uint32_t>(other.z() + 0.0F) == bits[2]) {
+        break;
+      }
+      slot = (slot + 1) & (capacity - 1);
+    }
+
+    if (slots[slot] == kEmpty) {
+      // Unique vertices only move towards the front, so they can be compacted in place
+      slots[slot] = unique;
+      vertices[unique] = vert;
+      ++unique;
+    }
+
+    remap[idx] = slots[slot];
+  }
+
+  if (unique == vertices.size()) {
+    return;
+  }
+
+  vertices.resize(unique);
+  vertices.shrink_to_fit();
+
+  constexpr size_t kBlockSize = size_t{1} << 16;
+  rastrum::parallel::forEach((vert_indices.size() + kBlockSize - 1) / kBlockSize, threads,
+                             [&](size_t block) {
+                               const auto end =
+                                   std::min(vert_indices.size(), (block + 1) * kBlockSize);
+                               for (auto idx = block * kBlockSize; idx < end; ++idx) {
+                                 vert_indices[idx] = remap[vert_indices[idx]];
+                               }
+                             });
+}
@@ -0,0 +1,28 @@
+#ifndef RASTRUM_MESH_H
+#define RASTRUM_MESH_H
+
+#include <cstdint>
+#include <vector>
+
+#include "rastrum/Vector.h"
+
+namespace rastrum::mesh {
+
+/**
+ * Triangulates a polygon written as a fan at indices by ear clipping, so concave polygons come
+ * out right. The polygon is flattened onto the axis plane it faces most, and the triangles keep
+ * its winding. Polygons with no ears left, such as self intersecting ones, keep the rest of the
+ * fan.
+ */
+void triangulate(uint32_t* indices, size_t sides, const Vector3DF* vertices);
+
+/**
+ * Merges vertices with identical positions, keeping the first of each in order, and updates
+ * vert_indices to match using up to threads workers. Uses an open addressing hash table of
+ * indices into vertices.
+ */
+void weld(std::vector<Vector3DF>& vertices, std::vector<uint32_t>& vert_indices, size_t threads);
+
+}  // namespace rastrum::mesh
+
+#endif
@@ -0,0 +1,62 @@
+#include "parallel.h"
+
+rastrum::parallel::Pool::Pool(size_t threads) {
+  const auto workers = std::max<size_t>(threads, 1) - 1;
+  _workers.reserve(workers);
+  for (size_t worker = 0; worker < workers; ++worker) {
+    _workers.emplace_back([this]() { workerLoop(); });
+  }
+}
+
+rastrum::parallel::Pool::~Pool() {
+  {
+    const std::lock_guard lock(_mutex);
+    _stopping = true;
+  }
+  _start.notify_all();
+}
+
+auto rastrum::parallel::Pool::threads() const -> size_t {
+  return _workers.size() + 1;
+}
+
+void rastrum::parallel::Pool::run(const std::function<void()>& work) {
+  {
+    const std::lock_guard lock(_mutex);
+    _work = &work;
+    _running = _workers.size();
+    ++_round;
+  }
+  _start.notify_all();
+
+  work();
+
+  std::unique_lock lock(_mutex);
+  _done.wait(lock, [this]() { return _running == 0; });
+  _work = nullptr;
+}
+
+void rastrum::parallel::Pool::workerLoop() {
+  size_t round = 0;
+
+  while (true) {
+    const std::function<void()>* work = nullptr;
+    {
+      std::unique_lock lock(_mutex);
+      _start.wait(lock, [&]() { return _stopping || _round != round; });
+      if (_stopping) {
+        return;
+      }
+      round = _round;
+      work = _work;
+    }
+
+    (*work)();
+
+    {
+      const std::lock_guard lock(_mutex);
+      --_running;
+    }
+    _done.notify_one();
+  }
+}
@@ -0,0 +1,110 @@
+#ifndef RASTRUM_PARALLEL_H
+#define RASTRUM_PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace rastrum::parallel {
+
+/** The number of threads to use when the caller has no preference. */
+inline auto defaultThreads() -> size_t {
+  return std::max<size_t>(1, std::thread::hardware_concurrency());
+}
+
+/**
+ * A fixed set of worker threads that live as long as the pool, for work that is repeated often
+ * enough, such as every frame, that starting and joining threads each time would show.
+ * Only one thread may call forEach() at a time.
+ */
+class Pool {
+ public:
+  /** Starts threads - 1 workers, the thread calling forEach() is the last one. */
+  explicit Pool(size_t threads);
+
+  /** Stops and joins the workers. */
+  ~Pool();
+
+  Pool(const Pool&) = delete;
+  auto operator=(const Pool&) -> Pool& = delete;
+
+  /** The number of threads that take part in forEach(), including the caller. */
+  auto threads() const -> size_t;
+
+  /**
+   * Calls fn(idx) for every idx in [0, count) on the workers and the calling thread.
+   * Work is handed out one index at a time so uneven items balance across workers.
+   * The call returns once every index is done. If fn throws, no more indices are started and the
+   * first exception is rethrown on the calling thread.
+   */
+  template <typename F>
+  void forEach(size_t count, F&& fn);
+
+ private:
+  /** Runs work on every worker and the calling thread, returning once all of them finish. */
+  void run(const std::function<void()>& work);
+
+  /** Waits for each round of work handed out by run() until the pool stops. */
+  void workerLoop();
+
+  std::mutex _mutex;
+  std::condition_variable _start;
+  std::condition_variable _done;
+  /** The work of the current round, valid while _running is non zero. */
+  const std::function<void()>* _work = nullptr;
+  /** Counts rounds, so a worker knows when a new one has started. */
+  size_t _round = 0;
+  /** The number of workers still running the current round. */
+  size_t _running = 0;
+  bool _stopping = false;
+  std::vector<std::jthread> _workers;
+};
+
+template <typename F>
+void Pool::forEach(size_t count, F&& fn) {
+  if (_workers.empty() || count <= 1) {
+    for (size_t idx = 0; idx < count; ++idx) {
+      fn(idx);
+    }
+    return;
+  }
+
+  std::atomic<size_t> next = 0;
+  std::exception_ptr error;
+  std::mutex error_mutex;
+  run([&]() {
+    try {
+      for (auto idx = next.fetch_add(1); idx < count; idx = next.fetch_add(1)) {
+        fn(idx);
+      }
+    } catch (...) {
+      next = count;
+      const std::lock_guard lock(error_mutex);
+      if (!error) {
+        error = std::current_exception();
+      }
+    }
+  });
+
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+/**
+ * Calls fn(idx) for every idx in [0, count) using up to threads workers, see Pool::forEach.
+ * The workers only last for the call, keep a Pool for work that repeats.
+ */
+template <typename F>
+void forEach(size_t count, size_t threads, F&& fn) {
+  Pool(std::min(threads, count)).forEach(count, std::forward<F>(fn));
+}
+
+}  // namespace rastrum::parallel
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef RASTRUM_SIMD_H
+#define RASTRUM_SIMD_H
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+
+#include <cstdint>
+
+#include "rastrum/Vector.h"
+
+namespace rastrum::simd {
+
+static_assert(sizeof(Vector3DF) == 3 * sizeof(float), "Vector3DF must be tightly packed");
+
+/** The number of points load3() and store3() move at once. */
+constexpr size_t kWidth = 4;
+
+/** Loads kWidth points and shuffles them so each register holds one coordinate of every point. */
+inline void load3(const Vector3DF* points, __m128& x, __m128& y, __m128& z) {
+  const auto* ptr = reinterpret_cast<const float*>(points);
+  const __m128 in0 = _mm_loadu_ps(ptr);      // x0 y0 z0 x1
+  const __m128 in1 = _mm_loadu_ps(ptr + 4);  // y1 z1 x2 y2
+  const __m128 in2 = _mm_loadu_ps(ptr + 8);  // z2 x3 y3 z3
+
+  const __m128 xyz2_x3 = _mm_shuffle_ps(in1, in2, _MM_SHUFFLE(1, 0, 3, 2));
+  const __m128 yz01 = _mm_shuffle_ps(in0, in1, _MM_SHUFFLE(1, 0, 2, 1));
+  const __m128 yz23 = _mm_shuffle_ps(xyz2_x3, in2, _MM_SHUFFLE(3, 2, 2, 1));
+  x = _mm_shuffle_ps(in0, xyz2_x3, _MM_SHUFFLE(3, 0, 3, 0));
+  y = _mm_shuffle_ps(yz01, yz23, _MM_SHUFFLE(2, 0, 2, 0));
+  z = _mm_shuffle_ps(yz01, yz23, _MM_SHUFFLE(3, 1, 3, 1));
+}
+
+/** The reverse of load3(), shuffles a register of each coordinate back into kWidth points. */
+inline void store3(Vector3DF* points, __m128 x, __m128 y, __m128 z) {
+  // Shuffle back to x0 y0 z0 x1 | y1 z1 x2 y2 | z2 x3 y3 z3
+  const __m128 yz01 = _mm_unpacklo_ps(y, z);
+  const __m128 yz23 = _mm_unpackhi_ps(y, z);
+  const __m128 x01_yz0 = _mm_shuffle_ps(x, yz01, _MM_SHUFFLE(1, 0, 1, 0));
+  const __m128 x22_yy2 = _mm_shuffle_ps(x, yz23, _MM_SHUFFLE(0, 0, 2, 2));
+  const __m128 zz2_x33 = _mm_shuffle_ps(yz23, x, _MM_SHUFFLE(3, 3, 1, 1));
+
+  auto* ptr = reinterpret_cast<float*>(points);
+  _mm_storeu_ps(ptr, _mm_shuffle_ps(x01_yz0, x01_yz0, _MM_SHUFFLE(1, 3, 2, 0)));
+  _mm_storeu_ps(ptr + 4, _mm_shuffle_ps(yz01, x22_yy2, _MM_SHUFFLE(2, 0, 3, 2)));
+  _mm_storeu_ps(ptr + 8, _mm_shuffle_ps(zz2_x33, yz23, _MM_SHUFFLE(3, 2, 2, 0)));
+}
+
+/** Scales x, y and z to unit length, leaving zero length vectors as zero. */
+inline void normalize3(__m128& x, __m128& y, __m128& z) {
+  const __m128 length_sq =
+      _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+  const __m128 nonzero = _mm_cmpgt_ps(length_sq, _mm_setzero_ps());
+  const __m128 scale = _mm_and_ps(nonzero, _mm_div_ps(_mm_set1_ps(1), _mm_sqrt_ps(length_sq)));
+  x = _mm_mul_ps(x, scale);
+  y = _mm_mul_ps(y, scale);
+  z = _mm_mul_ps(z, scale);
+}
+
+/** The number of integers toFloat() converts at once. */
+constexpr size_t kShortWidth = 8;
+
+/** Converts kShortWidth unsigned 16 bit integers to floats, neither pointer need be aligned. */
+inline void toFloat(const uint16_t* in, float* out) {
+  const __m128i shorts = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+  const __m128i zero = _mm_setzero_si128();
+  _mm_storeu_ps(out, _mm_cvtepi32_ps(_mm_unpacklo_epi16(shorts, zero)));
+  _mm_storeu_ps(out + 4, _mm_cvtepi32_ps(_mm_unpackhi_epi16(shorts, zero)));
+}
+
+}  // namespace rastrum::simd
+
+#endif
+
+#endif